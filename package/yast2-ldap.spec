@@ -26,6 +26,7 @@ Source0:        %{name}-%{version}.tar.bz2
 Group:          System/YaST
 License:        GPL-2.0-only
 BuildRequires:	gcc-c++ libldapcpp-devel yast2-core-devel yast2 libtool
+BuildRequires:  libopenssl-devel
 BuildRequires:  yast2-devtools >= 3.1.10
 Summary:	YaST2 - LDAP Agent
 Requires: 	ldapcpplib yast2 yast2-network
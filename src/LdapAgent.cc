@@ -28,7 +28,24 @@
  */
 
 #include "LdapAgent.h"
+#include "LdapGroupGraph.h"
+#include "LdapFilter.h"
 #include <ctype.h>
+#include <strings.h>
+
+#include <LDAPMessageQueue.h>
+#include <LDAPResult.h>
+#include <LDAPSearchResult.h>
+#include <lber.h>
+#include <ldap.h>
+
+#include <deque>
+#include <set>
+#include <sstream>
+#include <vector>
+
+#define PRE_READ_OID	"1.3.6.1.1.13.1"
+#define POST_READ_OID	"1.3.6.1.1.13.2"
 
 #define PC(n)       (path->component_str(n))
 
@@ -59,6 +76,142 @@ YCPString addBlanks (int uid)
     return YCPString(s);    
 }
 
+/**
+ * create the string describing search parameters that change the form
+ * of result entries (used as a part of cache key)
+ */
+string search_spec (StringList attrs, bool single_values, bool include_dn)
+{
+    std::set<string> sorted;
+    for (StringList::const_iterator i = attrs.begin(); i != attrs.end(); i++) {
+	sorted.insert (tolower (*i));
+    }
+    string spec;
+    for (std::set<string>::const_iterator i = sorted.begin(); i != sorted.end(); i++) {
+	spec += *i + ",";
+    }
+    spec += single_values ? "|s" : "|l";
+    spec += include_dn ? "d" : "";
+    return spec;
+}
+
+/**
+ * value of the key which is one DN or list of them
+ */
+static std::vector<string> dn_list (YCPMap map, const string &key)
+{
+    std::vector<string> ret;
+    YCPValue value	= map->value (YCPString (key));
+    if (!value.isNull () && value->isList ()) {
+	YCPList list	= value->asList ();
+	for (int i = 0; i < list->size (); i++) {
+	    if (list->value (i)->isString ())
+		ret.push_back (list->value (i)->asString ()->value ());
+	}
+    }
+    else if (!value.isNull () && value->isString ()) {
+	ret.push_back (value->asString ()->value ());
+    }
+    if (ret.empty ())
+	ret.push_back ("");
+    return ret;
+}
+
+/**
+ * join the strings with given separator
+ */
+static string join (const std::vector<string> &list, const string &sep)
+{
+    string ret;
+    for (unsigned i = 0; i < list.size (); i++) {
+	if (i > 0)
+	    ret += sep;
+	ret += list[i];
+    }
+    return ret;
+}
+
+/**
+ * delete the (not yet read) search results
+ */
+static void delete_results (std::vector<LdapResults*> &results)
+{
+    for (unsigned i = 0; i < results.size (); i++) {
+	delete results[i];
+    }
+    results.clear ();
+}
+
+/**
+ * find the values of member attribute (lowercase name); server with limit
+ * of returned values sends "member;range=0-1499" instead of "member":
+ * then next is set to the start of following range (-1 if there is none)
+ */
+static const LDAPAttribute* member_values (const LDAPAttributeList *al,
+    const string &member_attr, int &next)
+{
+    next	= -1;
+    string range	= member_attr + ";range=";
+    for (LDAPAttributeList::const_iterator i = al->begin(); i != al->end(); i++) {
+	string key	= tolower (i->getName ());
+	if (key == member_attr)
+	    return &(*i);
+	if (key.compare (0, range.size (), range) == 0) {
+	    string end	= key.substr (key.find ('-', range.size ()) + 1);
+	    if (end != "*")
+		next	= atoi (end.c_str ()) + 1;
+	    return &(*i);
+	}
+    }
+    return NULL;
+}
+
+/**
+ * attribute values of user or group map created by users.search, for
+ * matching by LdapFilter
+ */
+class YCPObject : public LdapFilter::Object
+{
+public:
+    YCPObject (const YCPMap &m) : map (m) {}
+
+    bool values (const string &attr, std::vector<string> &values) const
+    {
+	for (YCPMapIterator i = map->begin (); i != map->end (); i++) {
+	    if (i.key ()->isString () &&
+		strcasecmp (i.key ()->asString ()->value ().c_str (), attr.c_str ()) == 0) {
+		add (i.value (), values);
+		return true;
+	    }
+	}
+	return false;
+    }
+
+private:
+    YCPMap map;
+
+    static void add (const YCPValue &value, std::vector<string> &values)
+    {
+	if (value->isString ())
+	    values.push_back (value->asString ()->value ());
+	else if (value->isInteger ())
+	    values.push_back (value->toString ());
+	else if (value->isBoolean ())
+	    values.push_back (value->asBoolean ()->value () ? "TRUE" : "FALSE");
+	else if (value->isList ()) {
+	    YCPList list	= value->asList ();
+	    for (int i = 0; i < list->size (); i++)
+		add (list->value (i), values);
+	}
+	// members and group lists: the keys are the values
+	else if (value->isMap ()) {
+	    YCPMap map	= value->asMap ();
+	    for (YCPMapIterator i = map->begin (); i != map->end (); i++)
+		add (i.key (), values);
+	}
+    }
+};
+
 /**
  * Constructor
  */
@@ -66,6 +219,14 @@ LdapAgent::LdapAgent() : SCRAgent()
 {
     schema		= NULL;
     ldap		= NULL;
+    ldap_read		= NULL;
+    ldif		= NULL;
+    bound		= false;
+    has_primary		= false;
+    connection_lost	= false;
+    current_server	= 0;
+    tls_started		= false;
+    session_timeout	= SESSION_TIMEOUT;
     cons		= NULL;
     ldap_initialized	= false;
     tls_error		= false;
@@ -76,9 +237,10 @@ LdapAgent::LdapAgent() : SCRAgent()
  */
 LdapAgent::~LdapAgent()
 {
-    if (ldap) {
-	ldap->unbind();
-	delete ldap;
+    closeConnections (ldap, ldap_read);
+    for (std::multimap<string, Session>::iterator i = sessions.begin();
+	 i != sessions.end(); i++) {
+	closeConnections (i->second.ldap, i->second.ldap_read);
     }
     if (cons) {
 	delete cons;
@@ -86,6 +248,7 @@ LdapAgent::~LdapAgent()
     if (schema) {
 	delete schema;
     }
+    delete ldif;
 }
 
 /*
@@ -148,43 +311,53 @@ YCPList LdapAgent::getListValue (const YCPMap map, const string key)
  * creates YCPMap describing object returned as a part of LDAP search command
  * @param single_values if true, return string when argument has only one value
  */
-YCPMap LdapAgent::getSearchedEntry (LDAPEntry *entry, bool single_values)
+YCPMap LdapAgent::getSearchedEntry (const LDAPEntry *entry, bool single_values)
 {
+    double start = LdapStats::now ();
     YCPMap ret;	
     const LDAPAttributeList *al= entry->getAttributes();
     // go through attributes of current entry
     for (LDAPAttributeList::const_iterator i=al->begin(); i!=al->end(); i++) {
-	YCPValue value = YCPString ("");
-	// get the values of current attribute:
-	const StringList sl = i->getValues();
-	YCPList list = stringlist2ycplist (sl);
+	ret->add (YCPString (i->getName()), getAttributeValue (*i, single_values));
+    }
+    stats.received (entry, LdapStats::now () - start);
+    return ret;
+}
 
-	string key = i->getName();
-	// list of binary values
-	if (key.find (";binary") != string::npos) {
-	    BerValue **val = i->getBerValues();
-	    YCPList listvalue;
-	    for (int j=0; j < i->getNumValues (); j++) {
-		BerValue *one_val = val[j];
-		listvalue->add (YCPByteblock ((const unsigned char*) one_val->bv_val, one_val->bv_len));
-	    }
-	    if (single_values && i->getNumValues () == 1) {
-		value	= listvalue->value(0);
-	    }
-	    else {
-		value = listvalue;
-	    }
-	    ber_bvecfree(val);
-	}
-	// -------------------------------------------------------------------
-	else if (single_values && sl.size() == 1)
-	    value = YCPString (*(sl.begin()));
-	else
-	    value = YCPList (list);
+/**
+ * converts values of one attribute of searched object
+ * @param single_values if true, return string when argument has only one value
+ */
+YCPValue LdapAgent::getAttributeValue (const LDAPAttribute &attr,
+	bool single_values)
+{
+    YCPValue value = YCPString ("");
+    // get the values of current attribute:
+    const StringList sl = attr.getValues();
 
-	ret->add (YCPString (key), YCPValue(value));
+    string key = attr.getName();
+    // list of binary values
+    if (key.find (";binary") != string::npos) {
+	BerValue **val = attr.getBerValues();
+	YCPList listvalue;
+	for (int j=0; j < attr.getNumValues (); j++) {
+	    BerValue *one_val = val[j];
+	    listvalue->add (YCPByteblock ((const unsigned char*) one_val->bv_val, one_val->bv_len));
+	}
+	if (single_values && attr.getNumValues () == 1) {
+	    value	= listvalue->value(0);
+	}
+	else {
+	    value = listvalue;
+	}
+	ber_bvecfree(val);
     }
-    return ret;
+    // -------------------------------------------------------------------
+    else if (single_values && sl.size() == 1)
+	value = YCPString (*(sl.begin()));
+    else
+	value = stringlist2ycplist (sl);
+    return value;
 }
 
 /**
@@ -218,304 +391,2006 @@ YCPMap LdapAgent::getObjectAttributes (string dn)
     return ret;
 }
 
-
 /**
- * Return YCP of group, given as LDAP object
- * @param entry LDAP object of the group [item of search result]
- * @param member_attribute name of attribute with members ("member"/"uniqueMember")
+ * Return YCP of child entry: its DN and subordinates information
+ * (hasSubordinates is missing if server does not provide any of the
+ * operational attributes)
  */
-YCPMap LdapAgent::getGroupEntry (LDAPEntry *entry, string member_attribute)
+YCPMap LdapAgent::getChildEntry (const LDAPEntry *entry)
 {
-    YCPMap ret;	
-    const LDAPAttributeList *al= entry->getAttributes();
-    string member_attr	= tolower (member_attribute);
-    // go through attributes of current entry
-    for (LDAPAttributeList::const_iterator i=al->begin(); i!=al->end(); i++) {
-	YCPValue value = YCPString ("");
-	string key = i->getName();
-	string userlist;
-	
-	// get the values of current attribute:
-	const StringList sl = i->getValues();
-	YCPList list = stringlist2ycplist (sl);
-	
-	if ((sl.size() > 1 || tolower (key) == member_attr) && key != "cn")
-	{
-	    value = YCPList (list);
-	}
-	else
-	{
-	    string val = *(sl.begin());
-	    if ( tolower (key) == "gidnumber" )
-		value = YCPInteger (atoi (val.c_str()));
-	    else
-		value = YCPString (val);
-	}
+    double start = LdapStats::now ();
+    YCPMap ret;
+    ret->add (YCPString ("dn"), YCPString (entry->getDN ()));
 
-	ret->add(YCPString (key), YCPValue(value));
+    const LDAPAttributeList *al = entry->getAttributes ();
+    const LDAPAttribute *num = al->getAttributeByName ("numSubordinates");
+    const LDAPAttribute *has = al->getAttributeByName ("hasSubordinates");
+    if (num && num->getNumValues () > 0) {
+	int n	= atoi (num->getValues ().begin ()->c_str ());
+	ret->add (YCPString ("numSubordinates"), YCPInteger (n));
+	ret->add (YCPString ("hasSubordinates"), YCPBoolean (n > 0));
     }
-    // for the need of yast2-users
-    ret->add (YCPString ("type"), YCPString ("ldap"));
+    if (has && has->getNumValues () > 0) {
+	ret->add (YCPString ("hasSubordinates"),
+	    YCPBoolean (tolower (*(has->getValues ().begin ())) == "true"));
+    }
+    stats.received (entry, LdapStats::now () - start);
     return ret;
 }
 
+/**
+ * search the LDIF data or the server (the read connection)
+ */
+LdapResults* LdapAgent::search (string base, int scope, string filter,
+    StringList attrs, bool attrsOnly, const LDAPConstraints *c)
+{
+    if (ldif)
+	return ldif->search (base, scope, filter, attrs, attrsOnly);
+    return new LdapResults (ldap_read->search (base, scope, filter, attrs,
+	attrsOnly, c));
+}
 
 /**
- * Return YCP of user, given as LDAP object
- * @param entry LDAP object of the user [item of search result]
+ * start searches of all bases; missing base is only reported
  */
-YCPMap LdapAgent::getUserEntry (LDAPEntry *entry)
+bool LdapAgent::search_bases (const std::vector<string> &bases, int scope,
+    const string &filter, const StringList &attrs,
+    std::vector<LdapResults*> &results)
 {
-    YCPMap ret;
-	
-    const LDAPAttributeList *al= entry->getAttributes();
-    // go through attributes of current entry
-    for (LDAPAttributeList::const_iterator i=al->begin(); i!=al->end(); i++) {
-	YCPValue value = YCPString ("");
-	string key = i->getName();
-	string userlist;
-	
-	// get the values of current attribute:
-	const StringList sl = i->getValues();
-	YCPList list = stringlist2ycplist (sl);
-	
-	// list of binary values
-	if (key.find (";binary") != string::npos) {
-	    BerValue **val = i->getBerValues();
-	    YCPList listvalue;
-	    for (int j=0; j < i->getNumValues (); j++) {
-		BerValue *one_val = val[j];
-		listvalue->add (YCPByteblock ((const unsigned char*) one_val->bv_val, one_val->bv_len));
-	    }
-	    value = listvalue;
-	    ber_bvecfree(val);
-	}
-	// list of strings
-	else if (sl.size() > 1 && tolower (key) != "uid") {
-	    value = YCPList (list);
+    for (unsigned i = 0; i < bases.size (); i++) {
+	try {
+	    results.push_back (search_async (bases[i], scope, filter, attrs,
+		false, cons));
 	}
-	// string or integer
-	else {
-	    string val = *(sl.begin());
-	    if ( tolower (key) == "gidnumber" || tolower (key) == "uidnumber")
-		value = YCPInteger (atoi (val.c_str()));
-	    else
-		value = YCPString (val);
+	catch (LDAPException e) {
+	    if (e.getResultCode() == 32) {
+		y2warning ("%s not found", bases[i].c_str());
+		// keep results in the order of bases
+		results.push_back (new LdapResults ());
+		continue;
+	    }
+	    debug_exception (e, "searching for " + bases[i]);
+	    delete_results (results);
+	    return false;
 	}
-	ret->add(YCPString (key), YCPValue(value));
     }
-    
-    // for the need of yast2-users
-    ret->add (YCPString ("type"), YCPString ("ldap"));
-    if (ret->value (YCPString("userPassword")).isNull()) {
-	ret->add (YCPString ("userPassword"), YCPString ("x"));
+    return true;
+}
+
+/**
+ * start the search on the read connection without waiting for results
+ */
+LdapResults* LdapAgent::search_async (string base, int scope, string filter,
+    StringList attrs, bool attrsOnly, const LDAPConstraints *c)
+{
+    if (ldif)
+	return ldif->search (base, scope, filter, attrs, attrsOnly);
+    return new LdapResults (ldap_read->LDAPAsynConnection::search (base,
+	scope, filter, attrs, attrsOnly, c));
+}
+
+/**
+ * read the parameters of search from the map of Read (.ldap.search)
+ */
+LdapAgent::SearchArgs LdapAgent::search_args (YCPMap argmap)
+{
+    SearchArgs a;
+    a.base_dn		= getValue (argmap, "base_dn");
+    a.filter		= getValue (argmap, "filter");
+    if (a.filter == "") {
+	a.filter = "objectClass=*";
     }
-    return ret;
+    a.scope		= getIntValue (argmap, "scope", 0);
+    a.attrsOnly		= getBoolValue (argmap, "attrsOnly");
+    // when true, return map of type $[ dn: object ], not the list
+    // of objects (default is false = lists)
+    a.return_map	= getBoolValue (argmap, "map");
+    // when true, one-item values are returned as string, not
+    // as list with one value (default is false = always list)
+    a.single_values	= getBoolValue (argmap, "single_values");
+    // when true, only list of DN's will be returned
+    a.dn_only		= getBoolValue (argmap, "dn_only");
+    // when true, no error message is written when object was not found
+    // (empty list/map is returned)
+    a.not_found_ok	= getBoolValue (argmap, "not_found_ok");
+    // when true, "dn" key is included in result map of each object
+    a.include_dn	= getBoolValue (argmap, "include_dn");
+    a.attrs = ycplist2stringlist (getListValue (argmap, "attrs"));
+    // "table": $[ "attrs": [ names ], "rows": [ [ values ], ... ] ] is
+    // returned instead of map for each object; "columns" instead of
+    // "rows" with "columns" set to true
+    a.table		= getValue (argmap, "format") == "table" && !a.dn_only;
+    a.columns		= a.table && getBoolValue (argmap, "columns");
+
+    bool no_cache	= getBoolValue (argmap, "no_cache");
+    a.spec		= search_spec (a.attrs, a.single_values, a.include_dn);
+
+    // reading of one entry may be answered from the entry cache
+    // (cached value is map of type $[ dn: object ])
+    a.use_cache		= entry_cache.enabled () && a.scope == 0 &&
+	(a.filter == "objectClass=*" || a.filter == "(objectClass=*)") &&
+	!a.attrsOnly && !a.dn_only && !a.table && !no_cache;
+    // other searches may be answered from the query cache
+    // (cached value is the whole result)
+    a.use_query_cache	= query_cache.enabled () && !a.use_cache && !no_cache;
+    if (a.use_query_cache) {
+	a.query_spec = YCPInteger (a.scope)->toString() + "\n" + a.filter +
+	    "\n" + a.spec + (a.attrsOnly ? "a" : "") + (a.dn_only ? "n" : "") +
+	    (a.return_map ? "m" : "") + (a.table ? "t" : "") +
+	    (a.columns ? "c" : "");
+    }
+    return a;
 }
 
 /**
- * converts YCPList to StringList object
+ * return the cached result of the search, or YCPNull if there is none
  */
-StringList LdapAgent::ycplist2stringlist (YCPList l)
+YCPValue LdapAgent::cached_search (const SearchArgs &a)
 {
-    StringList sl;
-    for (int i=0; i < l->size(); i++) {
-	if (l.value(i)->isInteger()) {
-	    sl.add (l->value(i)->toString());
+    if (a.use_cache) {
+	YCPValue cached = entry_cache.lookup (a.base_dn, a.spec);
+	if (!cached.isNull ()) {
+	    y2debug ("(search call) base:'%s' found in cache",
+		a.base_dn.c_str());
+	    stats.note ("cached", 1);
+	    if (a.return_map) return cached;
+	    YCPList l;
+	    l->add (cached->asMap()->begin().value());
+	    return l;
 	}
-	else if (l.value(i)->isString()) {
-	    sl.add (l->value(i)->asString()->value());
+    }
+    if (a.use_query_cache) {
+	YCPValue cached = query_cache.lookup (a.base_dn, a.query_spec);
+	if (!cached.isNull ()) {
+	    y2debug ("(search call) base:'%s', filter:'%s' found in cache",
+		a.base_dn.c_str(), a.filter.c_str());
+	    stats.note ("cached", 1);
+	    return cached;
 	}
     }
-    return sl;
+    return YCPNull ();
 }
 
 /**
- * converts StringList object to YCPList value
+ * convert the found entry and add it to the result list or map
  */
-YCPList LdapAgent::stringlist2ycplist (StringList sl)
+void LdapAgent::add_search_entry (const SearchArgs &a, const LDAPEntry *entry,
+    YCPList &retlist, YCPMap &retmap)
 {
-    YCPList l;
-    for (StringList::const_iterator n = sl.begin(); n != sl.end();n++){
-	l->add (YCPString (*n));
+    string dn	= entry->getDN();
+    y2debug ("dn: %s", dn.c_str());
+    if (a.dn_only) {
+	stats.received (entry, 0);
+	retlist->add (YCPString (dn));
+	return;
     }
-    return l;
+    YCPMap e = getSearchedEntry (entry, a.single_values);
+    if (a.include_dn) {
+	e->add (YCPString ("dn"), YCPString (dn));
+    }
+    if (a.use_cache) {
+	YCPMap cached;
+	cached->add (YCPString (dn), e);
+	entry_cache.store (a.base_dn, a.scope, a.spec, cached);
+    }
+    if (a.return_map) {
+	retmap->add (YCPString (dn), e);
+    }
+    else
+	retlist->add (e);
 }
 
 /**
- * converts StringList object to YCPList value + each item is lowercased
+ * add the found entry to the result in "table" format: the row (or values
+ * of columns) is filled in the order of the columns, attributes not seen
+ * before get new columns at the end
  */
-YCPList LdapAgent::stringlist2ycplist_low (StringList sl)
+void LdapAgent::add_table_entry (const SearchArgs &a, const LDAPEntry *entry,
+    SearchTable &table)
 {
-    YCPList l;
-    for (StringList::const_iterator n = sl.begin(); n != sl.end();n++){
-	l->add (YCPString (tolower (*n)));
+    double start = LdapStats::now ();
+    YCPList row;
+    unsigned known	= table.names.size ();
+    for (unsigned c = 0; c < known; c++) {
+	YCPValue value	= YCPVoid ();
+	if (c == 0)
+	    value	= YCPString (entry->getDN());
+	else {
+	    const LDAPAttribute *attr = entry->getAttributeByName (table.names[c]);
+	    if (attr)
+		value	= getAttributeValue (*attr, a.single_values);
+	}
+	if (a.columns)
+	    table.column_lists[c]->add (value);
+	else
+	    row->add (value);
     }
-    return l;
+    const LDAPAttributeList *al= entry->getAttributes();
+    for (LDAPAttributeList::const_iterator i=al->begin(); i!=al->end(); i++) {
+	string key	= tolower (i->getName());
+	if (table.columns.find (key) != table.columns.end ())
+	    continue;
+	// new attribute: it is missing in previous rows (shorter rows,
+	// nil at the start of new column)
+	table.columns[key]	= table.names.size ();
+	table.names.push_back (i->getName());
+	YCPValue value	= getAttributeValue (*i, a.single_values);
+	if (a.columns) {
+	    YCPList column;
+	    for (int r = 0; r < table.count; r++)
+		column->add (YCPVoid ());
+	    column->add (value);
+	    table.column_lists.push_back (column);
+	}
+	else
+	    row->add (value);
+    }
+    if (!a.columns)
+	table.rows->add (row);
+    table.count++;
+    stats.received (entry, LdapStats::now () - start);
 }
 
 /**
- * creates attributes for new LDAP object and fills their values 
+ * create the result in "table" format; the header contains "dn" and
+ * requested attributes in given order, then the others as they came
  */
-void LdapAgent::generate_attr_list (LDAPAttributeList* attrs, YCPMap map)
+YCPMap LdapAgent::table_result (const SearchArgs &a, const SearchTable &table)
 {
-    for (YCPMapIterator i = map->begin(); i != map->end(); i++) {
-	if (i.key()->isString()) {
-	    string key = i.key()->asString()->value();
-	    // add a new attribute and its value to entry
-	    LDAPAttribute new_attr;
-	    new_attr.setName (i.key()->asString()->value());
-	    if (i.value()->isString()) {
-		if (i.value()->asString()->value() == "")
-		    continue;
-		new_attr.addValue (i.value()->asString()->value());
-	    }
-	    else if (i.value()->isInteger()) {
-		new_attr.addValue (i.value()->toString());
-	    }
-	    else if (i.value()->isByteblock ()) {
-		YCPByteblock data = i.value()->asByteblock();
+    YCPMap ret;
+    YCPList names;
+    for (unsigned i = 0; i < table.names.size (); i++)
+	names->add (YCPString (table.names[i]));
+    ret->add (YCPString ("attrs"), names);
 
-		BerValue *val = (BerValue*) malloc(sizeof(BerValue));
+    if (a.columns) {
+	YCPList columns;
+	for (unsigned c = 0; c < table.column_lists.size (); c++)
+	    columns->add (table.column_lists[c]);
+	ret->add (YCPString ("columns"), columns);
+    }
+    else
+	ret->add (YCPString ("rows"), table.rows);
+    return ret;
+}
 
-		val->bv_len = data->size();
-		val->bv_val = (char*) malloc (sizeof(char)*(data->size()+1));
-    
-		memcpy (val->bv_val, data->value(), data->size());
+/**
+ * prepare the columns of "table" result: "dn" and the requested attributes
+ */
+void LdapAgent::init_table (const SearchArgs &a, SearchTable &table)
+{
+    table.count	= 0;
+    table.names.push_back ("dn");
+    table.columns["dn"]	= 0;
+    for (StringList::const_iterator i = a.attrs.begin (); i != a.attrs.end (); i++) {
+	string key	= tolower (*i);
+	if (key == "*" || key == "+" || key == "1.1" ||
+	    table.columns.find (key) != table.columns.end ())
+	    continue;
+	table.columns[key]	= table.names.size ();
+	table.names.push_back (*i);
+    }
+    // each column needs its own list
+    for (unsigned c = 0; a.columns && c < table.names.size (); c++)
+	table.column_lists.push_back (YCPList ());
+}
 
-		new_attr.addValue (val);
-		ber_bvfree (val);
-	    }
+/**
+ * empty result of the search (object was not found)
+ */
+YCPValue LdapAgent::empty_result (const SearchArgs &a)
+{
+    if (a.table) {
+	SearchTable table;
+	init_table (a, table);
+	return table_result (a, table);
+    }
+    if (a.return_map) return YCPMap();
+    else	      return YCPList();
+}
+
+/**
+ * return the result of the search (list or map), store complete one
+ * to the query cache
+ */
+YCPValue LdapAgent::search_result (const SearchArgs &a, const YCPList &retlist,
+    const YCPMap &retmap, bool complete)
+{
+    if (a.use_query_cache && complete) {
+	if (a.return_map || a.table)
+	    query_cache.store (a.base_dn, a.scope, a.query_spec, retmap);
+	else
+	    query_cache.store (a.base_dn, a.scope, a.query_spec, retlist);
+    }
+    if (a.return_map || a.table) return retmap;
+    else return retlist;
+}
+
+/**
+ * read the entries of search result and convert them; asynchronous
+ * search reports errors (e.g. missing base) only now
+ */
+YCPValue LdapAgent::read_search (const SearchArgs &a, LdapResults *entries)
+{
+    YCPList retlist;
+    YCPMap retmap;
+    SearchTable table;
+    if (a.table)
+	init_table (a, table);
+
+    // partial results are not cached
+    bool complete	= true;
+
+    // go throught result and generate return value
+    LDAPEntry* entry = new LDAPEntry();
+    bool ok = true;
+    while (ok) {
+	try {
+	    {
+		LdapStats::Wait wait (stats);
+		entry = entries->getNext();
+	    }
+	    if (entry != 0) {
+		if (a.table)
+		    add_table_entry (a, entry, table);
+		else
+		    add_search_entry (a, entry, retlist, retmap);
+	    }
+	    else ok = false;
+	    delete entry;
+	}
+	catch (LDAPReferralException e) {
+	    debug_referral (e, "going through search result");
+	    complete	= false;
+	}
+	catch  (LDAPException e) {
+	    if (e.getResultCode() == 32) {
+		delete entries;
+		if (a.not_found_ok) {
+		    y2debug ("object not found");
+		    return empty_result (a);
+		}
+		debug_exception (e, "searching for " + a.base_dn);
+		return YCPVoid ();
+	    }
+	    // asynchronous search failed
+	    debug_exception (e, "searching for " + a.base_dn);
+	    delete entries;
+	    return YCPVoid ();
+	}
+    }
+    delete entries;
+    if (a.table)
+	retmap	= table_result (a, table);
+    return search_result (a, retlist, retmap, complete);
+}
+
+/**
+ * start asynchronous one-level search for children of given entry
+ */
+LDAPMessageQueue* LdapAgent::searchChildren (string dn)
+{
+    StringList attrs;
+    attrs.add ("hasSubordinates");
+    attrs.add ("numSubordinates");
+    return ldap_read->LDAPAsynConnection::search (dn, LDAPConnection::SEARCH_ONE,
+	"objectClass=*", attrs, false, cons);
+}
+
+/**
+ * read the result of asynchronous one-level search started by
+ * searchChildren; throws LDAPException on error
+ */
+YCPList LdapAgent::readChildren (LDAPMessageQueue *q)
+{
+    YCPList ret;
+    bool done	= false;
+    while (!done) {
+	LDAPMsg *msg = NULL;
+	try {
+	    LdapStats::Wait wait (stats);
+	    msg = q->getNext ();
+	}
+	catch (LDAPException e) {
+	    delete q;
+	    throw;
+	}
+	if (msg == NULL)
+	    break;
+
+	switch (msg->getMessageType ()) {
+	    case LDAPMsg::SEARCH_ENTRY:
+		ret->add (getChildEntry (((LDAPSearchResult*) msg)->getEntry ()));
+		break;
+	    case LDAPMsg::SEARCH_DONE: {
+		LDAPResult *res	= (LDAPResult*) msg;
+		int code	= res->getResultCode ();
+		if (code != LDAPResult::SUCCESS) {
+		    string err	= res->getErrMsg ();
+		    delete msg;
+		    delete q;
+		    throw LDAPException (code, err);
+		}
+		done	= true;
+		break;
+	    }
+	    default:
+		break;
+	}
+	delete msg;
+    }
+    delete q;
+    return ret;
+}
+
+/**
+ * get the list of children of given entry, prefetch the children
+ * of returned entries up to given depth into children_cache
+ */
+YCPList LdapAgent::getChildren (string dn, int prefetch)
+{
+    YCPList ret;
+    if (ldif) {
+	// LDIF data are in memory, no need to cache or prefetch them
+	StringList attrs;
+	attrs.add ("hasSubordinates");
+	attrs.add ("numSubordinates");
+	LdapResults *entries = ldif->search (dn, LDAPConnection::SEARCH_ONE,
+	    "objectClass=*", attrs, false);
+	for (LDAPEntry *entry; (entry = entries->getNext ()) != NULL;) {
+	    ret->add (getChildEntry (entry));
+	    delete entry;
+	}
+	delete entries;
+	return ret;
+    }
+    YCPValue cached = children_cache.lookup (dn, "");
+    if (!cached.isNull ()) {
+	y2debug ("children of '%s' found in cache", dn.c_str());
+	ret = cached->asList ();
+    }
+    else {
+	ret = readChildren (searchChildren (dn));
+    }
+
+    YCPList level	= ret;
+    int budget		= CHILDREN_CACHE_SIZE;
+    for (int depth = 0; depth < prefetch && level->size () > 0; depth++) {
+	// start searches for all entries of this level at once...
+	std::vector<std::pair <string, LDAPMessageQueue*> > queues;
+	for (int i = 0; i < level->size () && budget > 0; i++) {
+	    YCPMap child	= level->value (i)->asMap ();
+	    string child_dn	= getValue (child, "dn");
+	    if (!child->value (YCPString ("hasSubordinates")).isNull () &&
+		!getBoolValue (child, "hasSubordinates"))
+		continue;
+	    try {
+		queues.push_back (std::make_pair (child_dn, searchChildren (child_dn)));
+		budget--;
+	    }
+	    catch (LDAPException e) {
+		y2warning ("prefetch of children of '%s' failed", child_dn.c_str());
+	    }
+	}
+	// ... and collect the results
+	YCPList next;
+	for (unsigned i = 0; i < queues.size (); i++) {
+	    try {
+		YCPList children = readChildren (queues[i].second);
+		children_cache.store (queues[i].first, 1, "", children);
+		for (int j = 0; j < children->size (); j++) {
+		    next->add (children->value (j));
+		}
+	    }
+	    catch (LDAPException e) {
+		y2warning ("prefetch of children of '%s' failed",
+		    queues[i].first.c_str());
+	    }
+	}
+	level	= next;
+    }
+    return ret;
+}
+
+
+/**
+ * Return YCP of group, given as LDAP object
+ * @param entry LDAP object of the group [item of search result]
+ * @param member_attribute name of attribute with members ("member"/"uniqueMember")
+ */
+YCPMap LdapAgent::getGroupEntry (LDAPEntry *entry, string member_attribute)
+{
+    double start = LdapStats::now ();
+    YCPMap ret;	
+    const LDAPAttributeList *al= entry->getAttributes();
+    string member_attr	= tolower (member_attribute);
+    // go through attributes of current entry
+    for (LDAPAttributeList::const_iterator i=al->begin(); i!=al->end(); i++) {
+	YCPValue value = YCPString ("");
+	string key = i->getName();
+
+	// members are processed directly by users.search (see member_values)
+	string lkey = tolower (key);
+	if (lkey == member_attr ||
+	    lkey.compare (0, member_attr.size () + 7, member_attr + ";range=") == 0)
+	    continue;
+	
+	// get the values of current attribute:
+	const StringList sl = i->getValues();
+	YCPList list = stringlist2ycplist (sl);
+	
+	if (sl.size() > 1 && key != "cn")
+	{
+	    value = YCPList (list);
+	}
+	else
+	{
+	    string val = *(sl.begin());
+	    if ( tolower (key) == "gidnumber" )
+		value = YCPInteger (atoi (val.c_str()));
+	    else
+		value = YCPString (val);
+	}
+
+	ret->add(YCPString (key), YCPValue(value));
+    }
+    // for the need of yast2-users
+    ret->add (YCPString ("type"), YCPString ("ldap"));
+    stats.received (entry, LdapStats::now () - start);
+    return ret;
+}
+
+/**
+ * Read next range of group members (for servers limiting number of values)
+ * @param dn DN of the group
+ * @param member_attribute name of attribute with members
+ * @param from index of first value of the range
+ * @return entry with the range (to be deleted by caller), NULL on error
+ */
+LDAPEntry* LdapAgent::getMemberRange (string dn, string member_attribute,
+	int from)
+{
+    std::ostringstream attr;
+    attr << member_attribute << ";range=" << from << "-*";
+    StringList attrs;
+    attrs.add (attr.str ());
+    LDAPEntry *entry	= NULL;
+    LdapResults *entries	= NULL;
+    try {
+	LdapStats::Wait wait (stats);
+	entries	= search (dn, LDAPConnection::SEARCH_BASE, "objectClass=*",
+	    attrs, false, cons);
+	entry	= entries->getNext ();
+    }
+    catch (LDAPException e) {
+	debug_exception (e, "reading members of " + dn);
+    }
+    delete entries;
+    return entry;
+}
+
+/**
+ * Names of objects from the users or groups map matching the filter
+ * @param objects users or groups map (searched by users.search)
+ * @param filter LDAP search filter
+ * @return list of names, nil if the filter is not valid
+ */
+YCPValue LdapAgent::queryObjects (YCPMap objects, string filter)
+{
+    LdapFilter f;
+    if (!f.parse (filter)) {
+	debug_exception (LDAPException (LDAP_FILTER_ERROR, "Bad search filter"),
+	    "parsing filter " + filter);
+	return YCPVoid ();
+    }
+    YCPList ret;
+    for (YCPMapIterator i = objects->begin(); i != objects->end(); i++) {
+	if (f.match (YCPObject (i.value()->asMap())))
+	    ret->add (i.key());
+    }
+    return ret;
+}
+
+/**
+ * convert list of user names to YCP
+ */
+static YCPList names_list (const std::vector<string> &names)
+{
+    YCPList ret;
+    for (unsigned i = 0; i < names.size (); i++)
+	ret->add (YCPString (names[i]));
+    return ret;
+}
+
+/**
+ * Look up users by value of indexed attribute
+ */
+YCPValue LdapAgent::lookupUserIndex (YCPMap argmap)
+{
+    string attr	= tolower (getValue (argmap, "attr"));
+    bool ignore_case	= getBoolValue (argmap, "ignore_case");
+    map<string, UserIndex>::const_iterator index = user_indexes.find (attr);
+    if (index == user_indexes.end ()) {
+	y2error ("attribute '%s' is not indexed", attr.c_str ());
+	return YCPVoid ();
+    }
+    const map<string, std::vector<string> > &values =
+	ignore_case ? index->second.nocase : index->second.exact;
+
+    // whole index, e.g. for finding duplicates
+    if (argmap->value (YCPString ("value")).isNull ()) {
+	YCPMap ret;
+	for (map<string, std::vector<string> >::const_iterator i =
+	     values.begin (); i != values.end (); i++) {
+	    ret->add (YCPString (i->first), names_list (i->second));
+	}
+	return ret;
+    }
+    YCPValue value	= argmap->value (YCPString ("value"));
+    string v	= value->isString () ? value->asString ()->value () :
+	value->toString ();
+    map<string, std::vector<string> >::const_iterator i =
+	values.find (ignore_case ? tolower (v) : v);
+    if (i == values.end ())
+	return YCPList ();
+    return names_list (i->second);
+}
+
+/**
+ * Mark uidNumber and gidNumber of written entry as allocated; gidNumber
+ * of user is marked too (it is a GID of some group anyway)
+ */
+void LdapAgent::noteWrittenIds (YCPMap attrs)
+{
+    YCPObject object (attrs);
+    std::vector<string> values;
+    if (object.values ("uidnumber", values)) {
+	for (unsigned i = 0; i < values.size (); i++)
+	    if (values[i] != "")
+		uid_set.add (atoi (values[i].c_str ()));
+    }
+    values.clear ();
+    if (object.values ("gidnumber", values)) {
+	for (unsigned i = 0; i < values.size (); i++)
+	    if (values[i] != "")
+		gid_set.add (atoi (values[i].c_str ()));
+    }
+}
+
+/**
+ * Find free UID's or GID's
+ */
+YCPList LdapAgent::freeIds (const LdapIdSet &ids, YCPMap argmap)
+{
+    std::vector<int> free	= ids.free (getIntValue (argmap, "min", 1000),
+	getIntValue (argmap, "max", 60000), getIntValue (argmap, "count", 1));
+    YCPList ret;
+    for (unsigned i = 0; i < free.size (); i++)
+	ret->add (YCPInteger (free[i]));
+    return ret;
+}
+
+/**
+ * Compute effective memberships of the groups found by users.search:
+ * member which is a group brings all its members (transitively)
+ * @param member_attribute name of attribute with members
+ * @param dn_usernames normalized DN's of found users mapped to their names
+ */
+void LdapAgent::resolveNestedGroups (string member_attribute,
+	const map<string, string> &dn_usernames)
+{
+    LdapGroupGraph graph;
+    for (YCPMapIterator i = groups->begin(); i != groups->end(); i++) {
+	graph.add_group (getValue (i.value()->asMap(), "dn"));
+    }
+    for (YCPMapIterator i = groups->begin(); i != groups->end(); i++) {
+	YCPMap group	= i.value()->asMap();
+	string dn	= getValue (group, "dn");
+	YCPValue members = group->value (YCPString (member_attribute));
+	if (members.isNull() || !members->isMap())
+	    continue;
+	YCPMap mmap	= members->asMap();
+	for (YCPMapIterator m = mmap->begin(); m != mmap->end(); m++) {
+	    graph.add_member (dn, m.key()->asString()->value());
+	}
+    }
+    int cycles	= graph.resolve ();
+    if (cycles > 0)
+	y2warning ("%i cycles in group membership", cycles);
+
+    map<string, YCPMap> user_groups;
+    for (YCPMapIterator i = groups->begin(); i != groups->end(); i++) {
+	YCPString groupname	= i.key()->asString();
+	std::vector<string> members =
+	    graph.members (getValue (i.value()->asMap(), "dn"));
+	YCPMap mmap;
+	for (unsigned m = 0; m < members.size(); m++) {
+	    mmap->add (YCPString (members[m]), YCPInteger (1));
+	    map<string, string>::const_iterator u =
+		dn_usernames.find (LdapCache::normalize_dn (members[m]));
+	    // posixGroup members are user names already
+	    string username = u != dn_usernames.end() ? u->second :
+		(users->value (YCPString (members[m])).isNull() ? "" : members[m]);
+	    if (username != "")
+		user_groups[username]->add (groupname, YCPInteger (1));
+	}
+	effective_members->add (groupname, mmap);
+    }
+    for (map<string, YCPMap>::iterator i = user_groups.begin();
+	 i != user_groups.end(); i++) {
+	effective_groups->add (YCPString (i->first), i->second);
+    }
+}
+
+
+/**
+ * Return YCP of user, given as LDAP object
+ * @param entry LDAP object of the user [item of search result]
+ */
+YCPMap LdapAgent::getUserEntry (LDAPEntry *entry)
+{
+    double start = LdapStats::now ();
+    YCPMap ret;
+	
+    const LDAPAttributeList *al= entry->getAttributes();
+    // go through attributes of current entry
+    for (LDAPAttributeList::const_iterator i=al->begin(); i!=al->end(); i++) {
+	YCPValue value = YCPString ("");
+	string key = i->getName();
+	string userlist;
+	
+	// get the values of current attribute:
+	const StringList sl = i->getValues();
+	YCPList list = stringlist2ycplist (sl);
+	
+	// list of binary values
+	if (key.find (";binary") != string::npos) {
+	    BerValue **val = i->getBerValues();
+	    YCPList listvalue;
+	    for (int j=0; j < i->getNumValues (); j++) {
+		BerValue *one_val = val[j];
+		listvalue->add (YCPByteblock ((const unsigned char*) one_val->bv_val, one_val->bv_len));
+	    }
+	    value = listvalue;
+	    ber_bvecfree(val);
+	}
+	// list of strings
+	else if (sl.size() > 1 && tolower (key) != "uid") {
+	    value = YCPList (list);
+	}
+	// string or integer
+	else {
+	    string val = *(sl.begin());
+	    if ( tolower (key) == "gidnumber" || tolower (key) == "uidnumber")
+		value = YCPInteger (atoi (val.c_str()));
+	    else
+		value = YCPString (val);
+	}
+	ret->add(YCPString (key), YCPValue(value));
+    }
+    
+    // for the need of yast2-users
+    ret->add (YCPString ("type"), YCPString ("ldap"));
+    if (ret->value (YCPString("userPassword")).isNull()) {
+	ret->add (YCPString ("userPassword"), YCPString ("x"));
+    }
+    stats.received (entry, LdapStats::now () - start);
+    return ret;
+}
+
+/**
+ * converts YCPList to StringList object
+ */
+StringList LdapAgent::ycplist2stringlist (YCPList l)
+{
+    StringList sl;
+    for (int i=0; i < l->size(); i++) {
+	if (l.value(i)->isInteger()) {
+	    sl.add (l->value(i)->toString());
+	}
+	else if (l.value(i)->isString()) {
+	    sl.add (l->value(i)->asString()->value());
+	}
+    }
+    return sl;
+}
+
+/**
+ * converts StringList object to YCPList value
+ */
+YCPList LdapAgent::stringlist2ycplist (StringList sl)
+{
+    YCPList l;
+    for (StringList::const_iterator n = sl.begin(); n != sl.end();n++){
+	l->add (YCPString (*n));
+    }
+    return l;
+}
+
+/**
+ * converts StringList object to YCPList value + each item is lowercased
+ */
+YCPList LdapAgent::stringlist2ycplist_low (StringList sl)
+{
+    YCPList l;
+    for (StringList::const_iterator n = sl.begin(); n != sl.end();n++){
+	l->add (YCPString (tolower (*n)));
+    }
+    return l;
+}
+
+/**
+ * creates attributes for new LDAP object and fills their values 
+ */
+void LdapAgent::generate_attr_list (LDAPAttributeList* attrs, YCPMap map)
+{
+    for (YCPMapIterator i = map->begin(); i != map->end(); i++) {
+	if (i.key()->isString()) {
+	    string key = i.key()->asString()->value();
+	    // add a new attribute and its value to entry
+	    LDAPAttribute new_attr;
+	    new_attr.setName (i.key()->asString()->value());
+	    if (i.value()->isString()) {
+		if (i.value()->asString()->value() == "")
+		    continue;
+		new_attr.addValue (i.value()->asString()->value());
+	    }
+	    else if (i.value()->isInteger()) {
+		new_attr.addValue (i.value()->toString());
+	    }
+	    else if (i.value()->isByteblock ()) {
+		YCPByteblock data = i.value()->asByteblock();
+
+		BerValue *val = (BerValue*) malloc(sizeof(BerValue));
+
+		val->bv_len = data->size();
+		val->bv_val = (char*) malloc (sizeof(char)*(data->size()+1));
+    
+		memcpy (val->bv_val, data->value(), data->size());
+
+		new_attr.addValue (val);
+		ber_bvfree (val);
+	    }
 	    else if (i.value()->isList()) {
 		if (i.value()->asList()->isEmpty())
 		    continue;
 		// list of binary values...
 		if (key.find (";binary") != string::npos) {
 
-		    for (int j=0; j < i.value()->asList()->size(); j++) {
-			YCPByteblock data = i.value()->asList()->value(j)->asByteblock();
-			BerValue *val = (BerValue*) malloc(sizeof(BerValue));
+		    for (int j=0; j < i.value()->asList()->size(); j++) {
+			YCPByteblock data = i.value()->asList()->value(j)->asByteblock();
+			BerValue *val = (BerValue*) malloc(sizeof(BerValue));
+
+			val->bv_len = data->size();
+			val->bv_val = (char*) malloc (sizeof(char)*(data->size()+1));
+			memcpy (val->bv_val, data->value(), data->size());
+
+			new_attr.addValue (val);
+		    	ber_bvfree (val);
+		    }
+		}
+		else {
+		    // list of strings/integers
+		    new_attr.setValues(ycplist2stringlist(i.value()->asList()));
+		}
+	    }
+	    else continue;
+	    attrs->addAttribute (new_attr);
+	}
+    }
+}
+		
+/**
+ * creates list of modifications for LDAP object
+ * for removing attribute, give it empty value (sent as replace without
+ * values, so the modification is idempotent)
+ */
+void LdapAgent::generate_mod_list (LDAPModList* modlist, YCPMap map, YCPValue attrs)
+{
+    for (YCPMapIterator i = map->begin(); i != map->end(); i++) {
+	if (i.key()->isString()) {
+	    string key = i.key()->asString()->value();
+	    LDAPAttribute attr (key);
+	    attr.setName (key);
+	    bool present = true;
+	    if (attrs->isMap()) {
+		// check if attribute is present
+		present = !attrs->asMap()->value(YCPString (key)).isNull();
+	    }
+	    if (i.value()->isString() || i.value()->isInteger()) {
+		string val;
+		if (i.value()->isInteger()) {
+		    val = i.value()->toString();
+		}
+		else {
+		    val = i.value()->asString()->value();
+		}
+		if (val == "") {
+		    if (!present) {
+			y2warning ("No such attribute '%s'", key.c_str());
+			continue;
+		    }
+		    // replace without values removes the attribute and
+		    // can be repeated (delete would fail the second time)
+		}
+		else
+		    attr.addValue (val);
+	    }
+	    else if (i.value()->isList()) {
+		if (i.value()->asList()->isEmpty()) {
+		    if (!present) {
+			y2warning ("No such attribute '%s'", key.c_str());
+			continue;
+		    }
+		}
+		// list of binary values...
+		else if (key.find (";binary") != string::npos) {
+
+		    for (int j=0; j < i.value()->asList()->size(); j++) {
+			YCPByteblock data = i.value()->asList()->value(j)->asByteblock();
+			BerValue *val = (BerValue*) malloc(sizeof(BerValue));
+
+			val->bv_len = data->size();
+			val->bv_val = (char*) malloc (sizeof(char)*(data->size()+1));
+			memcpy (val->bv_val, data->value(), data->size());
+
+			attr.addValue (val);
+		    	ber_bvfree (val);
+		    }
+		}
+		// list of strings
+		else {
+		    attr.setValues (ycplist2stringlist (i.value()->asList()));
+		}
+	    }
+	    else if (i.value()->isByteblock ()) {
+		YCPByteblock data = i.value()->asByteblock();
+
+		BerValue *val = (BerValue*) malloc(sizeof(BerValue));
+
+		val->bv_len = data->size();
+		val->bv_val = (char*) malloc (sizeof(char)*(data->size()+1));
+    
+		memcpy (val->bv_val, data->value(), data->size());
+
+		attr.addValue (val);
+		ber_bvfree (val);
+	    }
+	    else continue;
+	    modlist->addModification (LDAPModification (attr,
+		LDAPModification::OP_REPLACE));
+	}
+    }
+}
+
+/**
+ * drop cached search results affected by the change of given entry
+ */
+void LdapAgent::invalidate_cache (string dn)
+{
+    entry_cache.invalidate (dn);
+    query_cache.invalidate (dn);
+    children_cache.invalidate (dn);
+}
+
+void LdapAgent::debug_exception (LDAPException e, string action)
+{
+    ldap_error = e.getResultMsg();
+    ldap_error_code = e.getResultCode();
+    if (ldap_error_code == LDAP_SERVER_DOWN ||
+	ldap_error_code == LDAP_CONNECT_ERROR) {
+	connection_lost	= true;
+    }
+    y2error ("ldap error while %s (%i): %s", action.c_str(), ldap_error_code,
+	    ldap_error.c_str());
+    if (e.getServerMsg() != "") {
+	y2error ("additional info: %s", e.getServerMsg().c_str());
+	server_error = e.getServerMsg();
+    }
+}
+
+// print the debug information about caught Referral Exception
+void LdapAgent::debug_referral (LDAPReferralException e, string action)
+{
+    const LDAPUrlList urls = e.getUrls ();
+    y2milestone ("caught referral; size of url list: %zi", urls.size ());
+    for (LDAPUrlList::const_iterator i=urls.begin(); i!=urls.end(); i++) {
+	y2milestone ("url: %s", i->getURLString ().c_str());
+    }
+}
+
+/**
+ * Return YCP of entry sent by server in Pre-Read or Post-Read control
+ * (the control value is encoded as SearchResultEntry, see RFC 4527)
+ */
+YCPMap LdapAgent::getControlEntry (const LDAPCtrl &ctrl)
+{
+    YCPMap ret;
+    string data	= ctrl.getData ();
+    struct berval bv;
+    bv.bv_val	= (char*) data.data ();
+    bv.bv_len	= data.size ();
+
+    BerElement *ber = ber_init (&bv);
+    if (!ber) {
+	return ret;
+    }
+    struct berval dn, name;
+    if (ber_scanf (ber, "{m{", &dn) == LBER_ERROR) {
+	y2error ("failed to decode value of control %s", ctrl.getOID().c_str());
+	ber_free (ber, 1);
+	return ret;
+    }
+    LDAPAttributeList attrs;
+    while (ber_scanf (ber, "{m", &name) != LBER_ERROR) {
+	BerVarray vals = NULL;
+	if (ber_scanf (ber, "[W]", &vals) == LBER_ERROR || vals == NULL) {
+	    break;
+	}
+	LDAPAttribute attr (string (name.bv_val, name.bv_len));
+	for (int i = 0; vals[i].bv_val != NULL; i++) {
+	    attr.addValue (&vals[i]);
+	}
+	ber_bvarray_free (vals);
+	attrs.addAttribute (attr);
+    }
+    LDAPEntry entry (string (dn.bv_val, dn.bv_len), &attrs);
+    ber_free (ber, 1);
+
+    ret = getSearchedEntry (&entry, false);
+    ret->add (YCPString ("dn"), YCPString (entry.getDN ()));
+    return ret;
+}
+
+/**
+ * add Pre-Read and/or Post-Read request controls to constraints
+ */
+void LdapAgent::set_read_controls (LDAPConstraints *c, YCPMap args,
+	bool pre_read, bool post_read)
+{
+    StringList attrs = ycplist2stringlist (getListValue (args, "return_attrs"));
+    if (attrs.empty ()) {
+	attrs.add ("*");
+    }
+    // AttributeSelection ::= SEQUENCE OF LDAPString
+    BerElement *ber = ber_alloc_t (LBER_USE_DER);
+    ber_printf (ber, "{");
+    for (StringList::const_iterator i = attrs.begin(); i != attrs.end(); i++) {
+	ber_printf (ber, "s", i->c_str());
+    }
+    ber_printf (ber, "N}");
+    struct berval bv;
+    ber_flatten2 (ber, &bv, 0);
+    string value (bv.bv_val, bv.bv_len);
+    ber_free (ber, 1);
+
+    // not critical: server without RFC 4527 support just returns no entry
+    LDAPControlSet cs;
+    if (pre_read) {
+	cs.add (LDAPCtrl (PRE_READ_OID, false, value));
+    }
+    if (post_read) {
+	cs.add (LDAPCtrl (POST_READ_OID, false, value));
+    }
+    c->setServerControls (&cs);
+}
+
+/**
+ * wait for the result of asynchronous write operation and save entries
+ * from Pre-Read/Post-Read controls; throws LDAPException on error
+ */
+void LdapAgent::finish_write (LDAPMessageQueue *q)
+{
+    LDAPResult *res = NULL;
+    try {
+	res = (LDAPResult*) q->getNext ();
+    }
+    catch (LDAPException e) {
+	delete q;
+	throw;
+    }
+    int code	= res->getResultCode ();
+    if (code == LDAPResult::REFERRAL) {
+	LDAPUrlList urls = res->getReferralUrls ();
+	delete res;
+	delete q;
+	throw LDAPReferralException (urls);
+    }
+    if (code != LDAPResult::SUCCESS) {
+	string msg = res->getErrMsg ();
+	delete res;
+	delete q;
+	throw LDAPException (code, msg);
+    }
+    const LDAPControlSet cs = res->getSrvControls ();
+    for (LDAPControlSet::const_iterator i = cs.begin(); i != cs.end(); i++) {
+	if (i->getOID () == PRE_READ_OID) {
+	    last_pre_entry = getControlEntry (*i);
+	}
+	else if (i->getOID () == POST_READ_OID) {
+	    last_entry = getControlEntry (*i);
+	}
+    }
+    delete res;
+    delete q;
+}
+
+/**
+ * create map describing failed record of Execute (.ldap.import)
+ */
+static YCPMap import_error (int line, const string &dn, int code,
+    const string &msg, const string &server_msg)
+{
+    YCPMap ret;
+    ret->add (YCPString ("line"), YCPInteger (line));
+    ret->add (YCPString ("dn"), YCPString (dn));
+    ret->add (YCPString ("code"), YCPInteger (code));
+    ret->add (YCPString ("msg"), YCPString (msg));
+    if (server_msg != "")
+	ret->add (YCPString ("server_msg"), YCPString (server_msg));
+    return ret;
+}
+
+/**
+ * check if operations on given (normalized) DNs could depend on each
+ * other: the same entry, or one is parent of the other
+ */
+static bool import_conflict (const string &a, const string &b)
+{
+    if (a == "" || b == "")
+	return false;
+    return a == b || LdapCache::parent_dn (a) == b ||
+	LdapCache::parent_dn (b) == a;
+}
+
+/**
+ * start asynchronous write operation of LDIF record: record without
+ * "changetype" (or with "add") is added, "modify", "delete" and
+ * "modrdn"/"moddn" records change the existing entry
+ */
+LDAPMessageQueue* LdapAgent::import_record (LDAPConnection *conn,
+    const string &dn, const LdifValues &values, string &type, string &new_dn)
+{
+    unsigned i		= 0;
+    string changetype	= "add";
+    // controls are not supported, operation is done without them
+    while (i < values.size () && tolower (values[i].first) == "control") {
+	y2warning ("control of '%s' ignored", dn.c_str());
+	i++;
+    }
+    if (i < values.size () && tolower (values[i].first) == "changetype") {
+	changetype	= tolower (values[i].second);
+	i++;
+    }
+
+    if (changetype == "add") {
+	LDAPAttributeList attrs;
+	LdifReader::add_attributes (attrs, values, i);
+	LDAPEntry entry (dn, &attrs);
+	type	= "added";
+	return conn->LDAPAsynConnection::add (&entry);
+    }
+    else if (changetype == "delete") {
+	type	= "deleted";
+	return conn->LDAPAsynConnection::del (dn);
+    }
+    else if (changetype == "modify") {
+	LDAPModList modlist;
+	while (i < values.size ()) {
+	    string op	= tolower (values[i].first);
+	    string attr	= values[i].second;
+	    LDAPModification::mod_op mod_op;
+	    if (op == "add")
+		mod_op	= LDAPModification::OP_ADD;
+	    else if (op == "delete")
+		mod_op	= LDAPModification::OP_DELETE;
+	    else if (op == "replace")
+		mod_op	= LDAPModification::OP_REPLACE;
+	    else
+		throw LDAPException (LDAP_PARAM_ERROR,
+		    "wrong modification '" + values[i].first + "'");
+	    LDAPAttribute attribute (attr);
+	    for (i++; i < values.size () && values[i].first != "-"; i++) {
+		if (tolower (values[i].first) != tolower (attr))
+		    throw LDAPException (LDAP_PARAM_ERROR,
+			"value of '" + values[i].first + "' in modification of '"
+			+ attr + "'");
+		attribute.addValue (values[i].second);
+	    }
+	    // skip the "-" separator
+	    i++;
+	    modlist.addModification (LDAPModification (attribute, mod_op));
+	}
+	type	= "modified";
+	return conn->LDAPAsynConnection::modify (dn, &modlist);
+    }
+    else if (changetype == "modrdn" || changetype == "moddn") {
+	string newrdn, newsuperior;
+	bool deleteoldrdn	= false;
+	for (; i < values.size (); i++) {
+	    string name	= tolower (values[i].first);
+	    if (name == "newrdn")
+		newrdn	= values[i].second;
+	    else if (name == "deleteoldrdn")
+		deleteoldrdn	= values[i].second == "1";
+	    else if (name == "newsuperior")
+		newsuperior	= values[i].second;
+	}
+	if (newrdn == "")
+	    throw LDAPException (LDAP_PARAM_ERROR, "missing newrdn");
+	string parent	= newsuperior;
+	if (parent == "") {
+	    string::size_type comma	= dn.find (',');
+	    parent	= comma == string::npos ? "" : dn.substr (comma + 1);
+	}
+	new_dn	= LdapCache::normalize_dn (parent == "" ? newrdn : newrdn + "," + parent);
+	type	= "renamed";
+	return conn->LDAPAsynConnection::rename (dn, newrdn, deleteoldrdn,
+	    newsuperior);
+    }
+    throw LDAPException (LDAP_PARAM_ERROR, "unsupported changetype '" +
+	changetype + "'");
+}
+
+/**
+ * wait for the result of import operation, add failure to errors
+ */
+bool LdapAgent::finish_import (ImportOp &op, YCPList &errors)
+{
+    try {
+	LdapStats::Wait wait (stats);
+	finish_write (op.q);
+	return true;
+    }
+    catch (LDAPReferralException e) {
+	debug_referral (e, "importing " + op.dn);
+	errors->add (import_error (op.line, op.dn, LDAPResult::REFERRAL, "Referral", ""));
+    }
+    catch (LDAPException e) {
+	debug_exception (e, "importing " + op.dn);
+	errors->add (import_error (op.line, op.dn, e.getResultCode (), e.getResultMsg (),
+	    e.getServerMsg ()));
+    }
+    return false;
+}
+
+/**
+ * import LDIF file: records are read one by one and sent as asynchronous
+ * write operations; up to "window" operations on each of "connections"
+ * connections wait for the result at once
+ */
+YCPValue LdapAgent::importLdif (YCPMap args)
+{
+    string file		= getValue (args, "file");
+    int window		= getIntValue (args, "window", IMPORT_WINDOW);
+    int connections	= getIntValue (args, "connections", 1);
+    bool stop_on_error	= getBoolValue (args, "stop_on_error");
+    if (window < 1)
+	window		= 1;
+    if (connections < 1)
+	connections	= 1;
+    stats.note ("file", file);
+
+    LdifReader reader;
+    if (!reader.open (file)) {
+	ldap_error	= reader.error ();
+	return YCPBoolean (false);
+    }
+
+    // more connections to the server for write operations
+    std::vector<LDAPConnection*> conns;
+    conns.push_back (ldap);
+    for (int i = 1; i < connections; i++) {
+	LDAPConnection *conn = openConnection (has_primary ? primary :
+	    servers[current_server]);
+	if (!conn) {
+	    y2warning ("importing with %i connections only", i);
+	    break;
+	}
+	conns.push_back (conn);
+    }
+    unsigned max_pending	= window * conns.size ();
+
+    std::deque<ImportOp> pending;
+    std::map<string, int> counts;
+    YCPList errors;
+    int records		= 0;
+    unsigned next_conn	= 0;
+    string dn;
+    LdifValues values;
+    while ((errors->size () == 0 || !stop_on_error) && reader.next (dn, values)) {
+	records++;
+	ImportOp op;
+	op.q	= NULL;
+	op.dn	= dn;
+	op.ndn	= LdapCache::normalize_dn (dn);
+	op.line	= reader.line ();
+	// incomplete record could change more than intended (e.g. delete
+	// all values of an attribute): do not send it
+	if (reader.value_error () != "") {
+	    errors->add (import_error (op.line, op.dn, LDAP_PARAM_ERROR,
+		reader.value_error (), ""));
+	    continue;
+	}
+	if (dn == "") {
+	    errors->add (import_error (op.line, op.dn, LDAP_PARAM_ERROR,
+		"record does not start with dn", ""));
+	    continue;
+	}
+	// operations on the entry, its parent or children could depend on
+	// each other: wait until the earlier ones are done
+	bool conflict	= true;
+	while (conflict) {
+	    conflict	= false;
+	    for (unsigned i = 0; i < pending.size () && !conflict; i++) {
+		conflict = import_conflict (pending[i].ndn, op.ndn) ||
+		    import_conflict (pending[i].new_dn, op.ndn);
+	    }
+	    if (conflict) {
+		if (finish_import (pending.front (), errors))
+		    counts[pending.front ().type]++;
+		pending.pop_front ();
+	    }
+	}
+	while (pending.size () >= max_pending) {
+	    if (finish_import (pending.front (), errors))
+		counts[pending.front ().type]++;
+	    pending.pop_front ();
+	}
+	try {
+	    op.q	= import_record (conns[next_conn], dn, values, op.type,
+		op.new_dn);
+	    next_conn	= (next_conn + 1) % conns.size ();
+	    pending.push_back (op);
+	}
+	catch (LDAPException e) {
+	    debug_exception (e, "importing " + dn);
+	    errors->add (import_error (op.line, op.dn, e.getResultCode (),
+		e.getResultMsg (), e.getServerMsg ()));
+	}
+    }
+    while (!pending.empty ()) {
+	if (finish_import (pending.front (), errors))
+	    counts[pending.front ().type]++;
+	pending.pop_front ();
+    }
+    for (unsigned i = 1; i < conns.size (); i++) {
+	closeConnections (conns[i], NULL);
+    }
+    // imported entries could be anywhere in the tree
+    entry_cache.clear ();
+    query_cache.clear ();
+    children_cache.clear ();
+
+    YCPMap ret;
+    ret->add (YCPString ("records"), YCPInteger (records));
+    const char *types[] = { "added", "modified", "deleted", "renamed", NULL };
+    for (int i = 0; types[i] != NULL; i++) {
+	ret->add (YCPString (types[i]), YCPInteger (counts[types[i]]));
+    }
+    ret->add (YCPString ("failed"), YCPInteger (errors->size ()));
+    ret->add (YCPString ("errors"), errors);
+    ret->add (YCPString ("connections"), YCPInteger ((int) conns.size ()));
+    return ret;
+}
+
+/**
+ * write the entry of search result message to LDIF, without copying
+ * the values; throws LDAPException on decoding error
+ */
+static void export_entry (LdifWriter &writer, LDAP *ld, LDAPMessage *msg)
+{
+    BerElement *ber	= NULL;
+    struct berval dn;
+    int rc	= ldap_get_dn_ber (ld, msg, &ber, &dn);
+    if (rc != LDAP_SUCCESS) {
+	if (ber)
+	    ber_free (ber, 0);
+	throw LDAPException (rc, ldap_err2string (rc));
+    }
+    writer.entry (dn.bv_val, dn.bv_len);
+
+    struct berval attr;
+    struct berval *vals	= NULL;
+    while ((rc = ldap_get_attribute_ber (ld, msg, ber, &attr, &vals)) ==
+	LDAP_SUCCESS && attr.bv_val != NULL) {
+	for (int i = 0; vals && vals[i].bv_val != NULL; i++) {
+	    writer.value (attr.bv_val, attr.bv_len, vals[i].bv_val,
+		vals[i].bv_len);
+	}
+	ber_memfree (vals);
+	vals	= NULL;
+    }
+    ber_free (ber, 0);
+    if (rc != LDAP_SUCCESS)
+	throw LDAPException (rc, ldap_err2string (rc));
+}
+
+/**
+ * page through the search result (Simple Paged Results control) and
+ * write the entries one by one, as they come
+ */
+int LdapAgent::export_pages (LdifWriter &writer, const string &base,
+    int scope, const string &filter, const StringList &attrs, int page_size)
+{
+    LDAP *ld	= ldap_read->getSessionHandle ();
+
+    std::vector<string> attr_names (attrs.begin (), attrs.end ());
+    std::vector<char*> attr_array;
+    for (unsigned i = 0; i < attr_names.size (); i++)
+	attr_array.push_back ((char*) attr_names[i].c_str ());
+    attr_array.push_back (NULL);
 
-			val->bv_len = data->size();
-			val->bv_val = (char*) malloc (sizeof(char)*(data->size()+1));
-			memcpy (val->bv_val, data->value(), data->size());
+    struct berval cookie	= { 0, NULL };
+    int pages	= 0;
+    int code	= LDAP_SUCCESS;
+    string error;
+    bool more	= true;
+    while (more && code == LDAP_SUCCESS) {
+	more	= false;
+	// server not supporting paging returns everything at once
+	LDAPControl *ctrls[2]	= { NULL, NULL };
+	if (page_size > 0) {
+	    code = ldap_create_page_control (ld, page_size, &cookie, 0, &ctrls[0]);
+	    if (code != LDAP_SUCCESS)
+		break;
+	}
+	int msgid;
+	code	= ldap_search_ext (ld, base.c_str (), scope, filter.c_str (),
+	    attrs.empty () ? NULL : &attr_array[0], 0, ctrls, NULL, NULL, 0,
+	    &msgid);
+	if (ctrls[0])
+	    ldap_control_free (ctrls[0]);
+	if (code != LDAP_SUCCESS)
+	    break;
+	pages++;
 
-			new_attr.addValue (val);
-		    	ber_bvfree (val);
-		    }
+	bool done	= false;
+	while (!done) {
+	    LDAPMessage *msg	= NULL;
+	    int type;
+	    {
+		LdapStats::Wait wait (stats);
+		type	= ldap_result (ld, msgid, LDAP_MSG_ONE, NULL, &msg);
+	    }
+	    if (type == -1 || type == 0) {
+		ldap_get_option (ld, LDAP_OPT_RESULT_CODE, &code);
+		if (code == LDAP_SUCCESS)
+		    code	= LDAP_OTHER;
+		ldap_msgfree (msg);
+		break;
+	    }
+	    if (type == LDAP_RES_SEARCH_ENTRY) {
+		try {
+		    export_entry (writer, ld, msg);
 		}
-		else {
-		    // list of strings/integers
-		    new_attr.setValues(ycplist2stringlist(i.value()->asList()));
+		catch (LDAPException e) {
+		    ldap_msgfree (msg);
+		    ldap_abandon_ext (ld, msgid, NULL, NULL);
+		    ber_memfree (cookie.bv_val);
+		    throw;
 		}
 	    }
-	    else continue;
-	    attrs->addAttribute (new_attr);
+	    else if (type == LDAP_RES_SEARCH_RESULT) {
+		char *errmsg		= NULL;
+		LDAPControl **sctrls	= NULL;
+		int rc	= ldap_parse_result (ld, msg, &code, NULL, &errmsg,
+		    NULL, &sctrls, 0);
+		if (rc != LDAP_SUCCESS)
+		    code	= rc;
+		if (errmsg) {
+		    error	= errmsg;
+		    ldap_memfree (errmsg);
+		}
+		// the cookie of next page
+		ber_memfree (cookie.bv_val);
+		cookie.bv_val	= NULL;
+		cookie.bv_len	= 0;
+		LDAPControl *page = ldap_control_find (LDAP_CONTROL_PAGEDRESULTS,
+		    sctrls, NULL);
+		if (code == LDAP_SUCCESS && page) {
+		    ber_int_t estimate;
+		    ldap_parse_pageresponse_control (ld, page, &estimate, &cookie);
+		    more	= cookie.bv_len > 0;
+		}
+		ldap_controls_free (sctrls);
+		done	= true;
+	    }
+	    // search references are not followed
+	    ldap_msgfree (msg);
+	}
+    }
+    ber_memfree (cookie.bv_val);
+    if (code != LDAP_SUCCESS) {
+	if (error != "") {
+	    y2error ("additional info: %s", error.c_str());
+	    server_error	= error;
 	}
+	throw LDAPException (code, ldap_err2string (code));
     }
+    return pages;
 }
-		
+
 /**
- * creates list of modifications for LDAP object
- * for removing attribute, give it empty value
+ * export subtree to LDIF file: entries are written as they come from
+ * the server (or from LDIF data), without conversion to YCP
  */
-void LdapAgent::generate_mod_list (LDAPModList* modlist, YCPMap map, YCPValue attrs)
+YCPValue LdapAgent::exportLdif (YCPMap args)
 {
-    for (YCPMapIterator i = map->begin(); i != map->end(); i++) {
-	if (i.key()->isString()) {
-	    string key = i.key()->asString()->value();
-	    LDAPAttribute attr (key);
-	    LDAPModification::mod_op op = LDAPModification::OP_REPLACE;
-	    attr.setName (key);
-	    bool present = true;
-	    if (attrs->isMap()) {
-		// check if attribute is present
-		present = !attrs->asMap()->value(YCPString (key)).isNull();
-	    }
-	    if (i.value()->isString() || i.value()->isInteger()) {
-		string val;
-		if (i.value()->isInteger()) {
-		    val = i.value()->toString();
-		}
-		else {
-		    val = i.value()->asString()->value();
-		}
-		if (val == "") {
-		    if (!present) {
-			y2warning ("No such attribute '%s'", key.c_str());
-			continue;
+    string base_dn	= getValue (args, "base_dn");
+    string file		= getValue (args, "file");
+    string filter	= getValue (args, "filter");
+    if (filter == "") {
+	filter = "objectClass=*";
+    }
+    int scope		= getIntValue (args, "scope", 2);
+    int page_size	= getIntValue (args, "page_size", EXPORT_PAGE_SIZE);
+    StringList attrs	= ycplist2stringlist (getListValue (args, "attrs"));
+    stats.note ("base", base_dn);
+    stats.note ("scope", scope);
+    stats.note ("filter", filter);
+    stats.note ("file", file);
+
+    LdifWriter writer;
+    if (!writer.open (file)) {
+	ldap_error	= writer.error ();
+	return YCPBoolean (false);
+    }
+    int pages	= 1;
+    try {
+	if (ldif) {
+	    LdapResults *entries = ldif->search (base_dn, scope, filter, attrs,
+		false);
+	    for (LDAPEntry *entry; (entry = entries->getNext ()) != NULL;) {
+		writer.entry (entry->getDN ().data (), entry->getDN ().size ());
+		const LDAPAttributeList *al = entry->getAttributes ();
+		for (LDAPAttributeList::const_iterator i = al->begin ();
+		     i != al->end (); i++) {
+		    const StringList &values	= i->getValues ();
+		    for (StringList::const_iterator v = values.begin ();
+			 v != values.end (); v++) {
+			writer.value (i->getName ().data (),
+			    i->getName ().size (), v->data (), v->size ());
 		    }
-		    op = LDAPModification::OP_DELETE;
 		}
-		else
-		    attr.addValue (val);
+		delete entry;
 	    }
-	    else if (i.value()->isList()) {
-		if (i.value()->asList()->isEmpty()) {
-		    if (!present) {
-			y2warning ("No such attribute '%s'", key.c_str());
-			continue;
-		    }
-		    op = LDAPModification::OP_DELETE;
-		}
-		// list of binary values...
-		else if (key.find (";binary") != string::npos) {
+	    delete entries;
+	}
+	else {
+	    pages = export_pages (writer, base_dn, scope, filter, attrs,
+		page_size);
+	}
+    }
+    catch (LDAPException e) {
+	debug_exception (e, "exporting " + base_dn);
+	writer.close ();
+	return YCPBoolean (false);
+    }
+    if (!writer.close ()) {
+	ldap_error	= writer.error ();
+	return YCPBoolean (false);
+    }
 
-		    for (int j=0; j < i.value()->asList()->size(); j++) {
-			YCPByteblock data = i.value()->asList()->value(j)->asByteblock();
-			BerValue *val = (BerValue*) malloc(sizeof(BerValue));
+    YCPMap ret;
+    ret->add (YCPString ("entries"), YCPInteger (writer.entries ()));
+    ret->add (YCPString ("bytes"), YCPInteger (writer.bytes ()));
+    ret->add (YCPString ("pages"), YCPInteger (pages));
+    return ret;
+}
 
-			val->bv_len = data->size();
-			val->bv_val = (char*) malloc (sizeof(char)*(data->size()+1));
-			memcpy (val->bv_val, data->value(), data->size());
+/**
+ * reset the information about last error
+ */
+void LdapAgent::clear_error ()
+{
+    ldap_error		= "";
+    server_error	= "";
+    ldap_error_code	= 0;
+    tls_error		= false;
+}
 
-			attr.addValue (val);
-		    	ber_bvfree (val);
-		    }
-		}
-		// list of strings
-		else {
-		    attr.setValues (ycplist2stringlist (i.value()->asList()));
-		}
-	    }
-	    else if (i.value()->isByteblock ()) {
-		YCPByteblock data = i.value()->asByteblock();
+/**
+ * check if both structures describe the same server
+ */
+bool LdapAgent::same_server (const LdapPingResult &a, const LdapPingResult &b)
+{
+    return a.uri == b.uri && a.host == b.host && a.port == b.port;
+}
 
-		BerValue *val = (BerValue*) malloc(sizeof(BerValue));
+/**
+ * create new connection to given server, start TLS according to
+ * parameters of Execute (.ldap) and bind again if bind was done before
+ */
+LDAPConnection* LdapAgent::openConnection (const LdapPingResult &server)
+{
+    LDAPConnection *conn = NULL;
+    try {
+	if (server.uri != "")
+	    conn = new LDAPConnection (server.uri, 0, cons);
+	else
+	    conn = new LDAPConnection (server.host, server.port, cons);
+	set_connection_options (conn, server);
+    }
+    catch (LDAPException e) {
+	debug_exception (e, "init");
+	delete conn;
+	y2error ("Error while initializing connection object");
+	return NULL;
+    }
 
-		val->bv_len = data->size();
-		val->bv_val = (char*) malloc (sizeof(char)*(data->size()+1));
-    
-		memcpy (val->bv_val, data->value(), data->size());
+    // start TLS if proper parameter is given
+    try {
+	if (tls_started)
+	    set_tls_options (tls_args, "yes");
+	else
+	    set_tls_options (conn_args, use_tls);
+    }
+    catch  (LDAPException e) {
+	debug_exception (e, "setting TLS options");
+	delete conn;
+	return NULL;
+    }
 
-		attr.addValue (val);
-		ber_bvfree (val);
+    // ldaps:// connection is encrypted from the beginning, ldapi://
+    // does not leave the machine; TLS started by explicit
+    // Execute (.ldap.start_tls) is required on new connections too
+    bool start_tls	= tls_started ||
+	((use_tls == "try" || use_tls == "yes") && !ldap_is_local (server));
+    if (start_tls && server.uri.compare (0, 8, "ldaps://") != 0) {
+	try {
+	    conn->start_tls ();
+	    tls_sessions.update (conn->getSessionHandle ());
+	}
+	catch  (LDAPException e) {
+	    // check if starting TLS failed
+	    debug_exception (e, "starting TLS");
+	    delete conn;
+	    conn	= NULL;
+	    // return an error if TLS is required; no bind is done, so the
+	    // password is never sent over unencrypted connection
+	    if (use_tls == "yes" || tls_started) {
+		tls_error	= true;
+		return NULL;
 	    }
-	    else continue;
-	    modlist->addModification (LDAPModification (attr, op));
+	    ldap_error = "";
+	    server_error = "";
+	    ldap_error_code = 0;
+	    // "try" -> start again, but without tls
+	    if (server.uri != "")
+		conn = new LDAPConnection (server.uri, 0, cons);
+	    else
+		conn = new LDAPConnection (server.host, server.port, cons);
+	    set_connection_options (conn, server);
+	    if (!conn || !cons)
+	    {
+		y2error ("Error while initializing connection object");
+		ldap_error 		= "init";
+		return NULL;
+	    }
+	}
+    }
+
+    if (bound) {
+	try {
+	    bindConnection (conn);
+	    tls_sessions.update (conn->getSessionHandle ());
+	}
+	catch (LDAPException e) {
+	    debug_exception (e, "binding with " + bind_dn);
+	    delete conn;
+	    return NULL;
 	}
     }
+    return conn;
 }
 
-void LdapAgent::debug_exception (LDAPException e, string action)
+/**
+ * key of TLS session cache: server and settings of its certificate check
+ * (session verified with weaker settings must not be resumed)
+ */
+string LdapAgent::tls_key (const LdapPingResult &server)
 {
-    ldap_error = e.getResultMsg();
-    ldap_error_code = e.getResultCode();
-    y2error ("ldap error while %s (%i): %s", action.c_str(), ldap_error_code,
-	    ldap_error.c_str());
-    if (e.getServerMsg() != "") {
-	y2error ("additional info: %s", e.getServerMsg().c_str());
-	server_error = e.getServerMsg();
+    std::ostringstream key;
+    if (server.uri != "")
+	key << server.uri;
+    else
+	key << server.host << ":" << server.port;
+    key << "\n" << getValue (conn_args, "cacertfile")
+	<< "\n" << getValue (conn_args, "cacertdir")
+	<< "\n" << getValue (conn_args, "require_cert");
+    return key.str ();
+}
+
+/**
+ * bind the connection with current credentials: simple bind with DN and
+ * password, or SASL EXTERNAL (identity of the process on ldapi://
+ * connection or TLS client certificate)
+ */
+void LdapAgent::bindConnection (LDAPConnection *conn)
+{
+    if (bind_mech == "") {
+	conn->bind (bind_dn, bind_pw, cons);
+	return;
+    }
+    // EXTERNAL needs no interaction, so it is done directly by libldap
+    struct berval cred = { 0, NULL };
+    int rc = ldap_sasl_bind_s (conn->getSessionHandle (),
+	NULL, bind_mech.c_str(), &cred, NULL, NULL, NULL);
+    if (rc != LDAP_SUCCESS) {
+	throw LDAPException (rc, ldap_err2string (rc));
     }
 }
 
-// print the debug information about caught Referral Exception
-void LdapAgent::debug_referral (LDAPReferralException e, string action)
+/**
+ * set socket options of new connection: connect timeout and TCP keepalive
+ * (so the dead connection is found before the kernel timeout), and
+ * the TLS session resumption
+ */
+void LdapAgent::set_connection_options (LDAPConnection *conn,
+    const LdapPingResult &server)
 {
-    const LDAPUrlList urls = e.getUrls ();
-    y2milestone ("caught referral; size of url list: %zi", urls.size ());
-    for (LDAPUrlList::const_iterator i=urls.begin(); i!=urls.end(); i++) {
-	y2milestone ("url: %s", i->getURLString ().c_str());
+    LDAP *ld	= conn->getSessionHandle ();
+    tls_sessions.attach (ld, tls_key (server));
+    int timeout	= getIntValue (conn_args, "network_timeout", 0);
+    if (timeout > 0) {
+	struct timeval tv;
+	tv.tv_sec	= timeout / 1000;
+	tv.tv_usec	= (timeout % 1000) * 1000;
+	ldap_set_option (ld, LDAP_OPT_NETWORK_TIMEOUT, &tv);
+    }
+    int idle	= getIntValue (conn_args, "keepalive_idle", 0);
+    int probes	= getIntValue (conn_args, "keepalive_probes", 0);
+    int interval = getIntValue (conn_args, "keepalive_interval", 0);
+    if (idle > 0)
+	ldap_set_option (ld, LDAP_OPT_X_KEEPALIVE_IDLE, &idle);
+    if (probes > 0)
+	ldap_set_option (ld, LDAP_OPT_X_KEEPALIVE_PROBES, &probes);
+    if (interval > 0)
+	ldap_set_option (ld, LDAP_OPT_X_KEEPALIVE_INTERVAL, &interval);
+}
+
+/**
+ * open new connection to given server and check that it works
+ * (without TLS and bind, connection is created only by first operation)
+ */
+LDAPConnection* LdapAgent::reopenConnection (const LdapPingResult &server)
+{
+    LDAPConnection *conn = openConnection (server);
+    if (!conn)
+	return NULL;
+
+    StringList attrs;
+    attrs.add ("1.1");
+    LDAPSearchResults *entries = NULL;
+    try {
+	entries = conn->search ("", 0, "objectClass=*", attrs);
+    }
+    catch (LDAPException e) {
+	if (e.getResultCode () == LDAP_SERVER_DOWN ||
+	    e.getResultCode () == LDAP_CONNECT_ERROR) {
+	    debug_exception (e, "reconnecting");
+	    delete conn;
+	    return NULL;
+	}
+	// e.g. no access to rootDSE: server is still alive
+    }
+    delete entries;
+    return conn;
+}
+
+/**
+ * replace lost connection by new one, with the same TLS settings and bind;
+ * for reads, try the same server at first, then check all servers
+ * and connect to the best one; writes go to the primary server only
+ */
+bool LdapAgent::reconnect (bool write)
+{
+    if (!ldap_initialized)
+	return false;
+
+    bool split	= ldap_read != ldap;
+    if (write && (split || has_primary)) {
+	y2milestone ("reconnecting to primary LDAP server %s:%i",
+	    primary.host.c_str(), primary.port);
+	LDAPConnection *conn = reopenConnection (primary);
+	if (!conn)
+	    return false;
+	// without split, the primary is also the read server
+	if (!split)
+	    ldap_read	= conn;
+	delete ldap;
+	ldap	= conn;
+	return true;
+    }
+
+    // usually the server just closed idle connection
+    int best	= current_server;
+    y2milestone ("reconnecting to LDAP server %s:%i",
+	servers[best].host.c_str(), servers[best].port);
+    LDAPConnection *conn = reopenConnection (servers[best]);
+    if (!conn && servers.size () > 1) {
+	best	= ldap_ping (servers, getIntValue (conn_args, "timeout",
+	    PING_TIMEOUT), false);
+	if (best == -1) {
+	    y2error ("None of LDAP servers is reachable");
+	    return false;
+	}
+	y2milestone ("failover to LDAP server %s:%i (%.1f ms)",
+	    servers[best].host.c_str(), servers[best].port,
+	    servers[best].latency);
+	if (split && same_server (primary, servers[best]))
+	    conn	= ldap;
+	else
+	    conn	= openConnection (servers[best]);
+    }
+    if (!conn)
+	return false;
+
+    if (split) {
+	if (ldap_read != conn)
+	    delete ldap_read;
+    }
+    else if (has_primary && !same_server (primary, servers[best])) {
+	// lost primary stays the write connection (reopened by the next
+	// write), only reads move to the other server
+	y2milestone ("writes stay on primary LDAP server %s:%i",
+	    primary.host.c_str(), primary.port);
+    }
+    else {
+	delete ldap;
+	ldap	= conn;
+    }
+    ldap_read		= conn;
+    current_server	= best;
+    hostname		= servers[best].host;
+    port		= servers[best].port;
+    return true;
+}
+
+/**
+ * unbind and delete connection objects (read connection may be the same
+ * as the write one)
+ */
+void LdapAgent::closeConnections (LDAPConnection *conn, LDAPConnection *conn_read)
+{
+    if (conn_read && conn_read != conn) {
+	tls_sessions.update (conn_read->getSessionHandle ());
+	conn_read->unbind();
+	delete conn_read;
+    }
+    if (conn) {
+	tls_sessions.update (conn->getSessionHandle ());
+	conn->unbind();
+	delete conn;
+    }
+}
+
+/**
+ * create the key of connection parameters of Execute (.ldap) call
+ */
+string LdapAgent::connection_key (YCPMap args)
+{
+    const char *keys[] = { "hostname", "port", "uris", "primary", "use_tls",
+	"cacertfile", "cacertdir", "require_cert", "network_timeout",
+	"keepalive_idle", "keepalive_probes", "keepalive_interval", NULL };
+    string key;
+    for (int i = 0; keys[i] != NULL; i++) {
+	YCPValue v = args->value (YCPString (keys[i]));
+	key += string (keys[i]) + "=" + (v.isNull () ? "" : v->toString ()) + "\n";
+    }
+    return key;
+}
+
+/**
+ * keep current connection for the next Execute (.ldap) with the same
+ * parameters (or close it, if it cannot be used again)
+ */
+void LdapAgent::park_session ()
+{
+    if (!ldap)
+	return;
+
+    if (session_key == "" || session_timeout <= 0) {
+	closeConnections (ldap, ldap_read);
+    }
+    else {
+	Session session;
+	session.ldap		= ldap;
+	session.ldap_read	= ldap_read;
+	session.servers		= servers;
+	session.current_server	= current_server;
+	session.bound		= bound;
+	session.tls_started	= tls_started;
+	session.tls_args	= tls_args;
+	session.last_used	= time (NULL);
+	sessions.insert (std::make_pair (session_key, session));
+    }
+    ldap	= NULL;
+    ldap_read	= NULL;
+    bound	= false;
+    tls_started	= false;
+    session_key	= "";
+
+    // close the oldest sessions over the limit
+    while (sessions.size () > MAX_SESSIONS) {
+	std::multimap<string, Session>::iterator oldest = sessions.begin();
+	for (std::multimap<string, Session>::iterator i = sessions.begin();
+	     i != sessions.end(); i++) {
+	    if (i->second.last_used < oldest->second.last_used)
+		oldest = i;
+	}
+	closeConnections (oldest->second.ldap, oldest->second.ldap_read);
+	sessions.erase (oldest);
+    }
+}
+
+/**
+ * take parked connection with given key, if there is one; the key does
+ * not contain the bind identity, so bound connection is reset to
+ * anonymous access and the caller has to bind on its own
+ * @return true if connection was found
+ */
+bool LdapAgent::resume_session (string key)
+{
+    std::multimap<string, Session>::iterator found = sessions.end();
+    std::pair<std::multimap<string, Session>::iterator,
+	std::multimap<string, Session>::iterator> range = sessions.equal_range (key);
+    for (std::multimap<string, Session>::iterator i = range.first;
+	 i != range.second; i++) {
+	if (found == sessions.end() ||
+	    i->second.last_used > found->second.last_used)
+	    found = i;
+    }
+    if (found == sessions.end())
+	return false;
+
+    Session &session	= found->second;
+    if (session.bound) {
+	try {
+	    session.ldap->bind ("", "", cons);
+	    if (session.ldap_read != session.ldap)
+		session.ldap_read->bind ("", "", cons);
+	}
+	catch (LDAPException e) {
+	    y2warning ("parked connection cannot be reset to anonymous: %s",
+		e.getResultMsg().c_str());
+	    closeConnections (session.ldap, session.ldap_read);
+	    sessions.erase (found);
+	    return false;
+	}
+    }
+    ldap		= session.ldap;
+    ldap_read		= session.ldap_read;
+    servers		= session.servers;
+    current_server	= session.current_server;
+    bound		= false;
+    tls_started		= session.tls_started;
+    tls_args		= session.tls_args;
+    bind_dn		= "";
+    bind_pw		= "";
+    bind_mech		= "";
+    hostname		= servers[current_server].host;
+    port		= servers[current_server].port;
+    session_key		= key;
+    sessions.erase (found);
+    return true;
+}
+
+/**
+ * close parked connections not used for longer than session_timeout
+ */
+void LdapAgent::expire_sessions ()
+{
+    time_t now	= time (NULL);
+    for (std::multimap<string, Session>::iterator i = sessions.begin();
+	 i != sessions.end();) {
+	if (now - i->second.last_used > session_timeout) {
+	    closeConnections (i->second.ldap, i->second.ldap_read);
+	    sessions.erase (i++);
+	}
+	else
+	    i++;
     }
 }
 
@@ -562,17 +2437,64 @@ YCPList LdapAgent::Dir(const YCPPath& path)
 }
 
 /**
- * Read
+ * check if the return value of agent call means an error
+ */
+bool LdapAgent::failed (const YCPValue &ret)
+{
+    return ret.isNull () || ret->isVoid () ||
+	(ret->isBoolean () && !ret->asBoolean ()->value ());
+}
+
+/**
+ * add DN of the call (if there is one) and the result to current trace
+ * record
+ */
+void LdapAgent::note_result (const YCPValue &arg, bool failure)
+{
+    if (!arg.isNull () && arg->isMap ()) {
+	string dn	= getValue (arg->asMap (), "dn");
+	if (dn != "")
+	    stats.note ("dn", dn);
+    }
+    stats.note ("code", failure ? ldap_error_code : 0);
+    if (failure && ldap_error != "")
+	stats.note ("error", ldap_error);
+    if (connection_lost)
+	stats.note ("connection_lost", 1);
+}
+
+/**
+ * Read: when the connection was lost, fail over to other server and retry
  */
 YCPValue LdapAgent::Read(const YCPPath &path, const YCPValue& arg, const YCPValue& opt) {
 
+    LdapStats::Span span (stats, "read" + path->toString());
+    expire_sessions ();
+    connection_lost	= false;
+    YCPValue ret	= readOnce (path, arg, opt);
+    if (connection_lost && reconnect (false)) {
+	y2milestone ("retrying Read (%s)", path->toString().c_str());
+	clear_error ();
+	ret		= readOnce (path, arg, opt);
+    }
+    span.failed (failed (ret));
+    note_result (arg, failed (ret));
+    return ret;
+}
+
+/**
+ * Read one time
+ */
+YCPValue LdapAgent::readOnce(const YCPPath &path, const YCPValue& arg, const YCPValue& opt) {
+
     y2debug ("path in Read: '%s'.", path->toString().c_str());
     YCPValue ret = YCPVoid();
 	
     YCPMap argmap;
     if (!arg.isNull() && arg->isMap())
     	argmap = arg->asMap();
-    if (!ldap_initialized && PC(0) != "error") {
+    if (!ldap_initialized && PC(0) != "error" && PC(0) != "stats" &&
+	PC(0) != "slow_ops") {
 	y2error ("Ldap not initialized: use Execute(.ldap) first!");
 	ldap_error = "init";
 	return YCPVoid();
@@ -580,6 +2502,26 @@ YCPValue LdapAgent::Read(const YCPPath &path, const YCPValue& arg, const YCPValu
 	
     if (path->length() == 1) {
 
+	/**
+	 * statistics of agent calls (and reset of them, if requested):
+	 * Read(.ldap.stats, $[ "reset": true ]) -> map
+	 */
+	if (PC(0) == "stats") {
+	    YCPMap retmap = stats.get ();
+	    if (getBoolValue (argmap, "reset"))
+		stats.reset ();
+	    return retmap;
+	}
+	/**
+	 * operations slower than "slow_threshold" of Execute (.ldap):
+	 * Read(.ldap.slow_ops, $[ "reset": true ]) -> list of maps
+	 */
+	if (PC(0) == "slow_ops") {
+	    YCPList retlist = stats.slow_ops ();
+	    if (getBoolValue (argmap, "reset"))
+		stats.reset_slow_ops ();
+	    return retlist;
+	}
 	/**
 	 * error: Read(.ldap.error) -> returns last error message
 	 */
@@ -602,93 +2544,56 @@ YCPValue LdapAgent::Read(const YCPPath &path, const YCPValue& arg, const YCPValu
 	 * (return value depends on value of "return_map" parameter
 	 */
 	else if (PC(0) == "search") {
-	    string base_dn	= getValue (argmap, "base_dn");
-	    string filter	= getValue (argmap, "filter");
-	    if (filter == "") {
-		filter = "objectClass=*";
-	    }
-	    int scope		= getIntValue (argmap, "scope", 0);
-	    bool attrsOnly	= getBoolValue (argmap, "attrsOnly");
-	    // when true, return map of type $[ dn: object ], not the list
-	    // of objects (default is false = lists)
-   	    bool return_map	= getBoolValue (argmap, "map");
-	    // when true, one-item values are returned as string, not
-	    // as list with one value (default is false = always list)
-   	    bool single_values	= getBoolValue (argmap, "single_values");
-	    // when true, only list of DN's will be returned
-	    bool dn_only	= getBoolValue (argmap, "dn_only");
-	    // when true, no error message is written when object was not found
-	    // (empty list/map is returned)
-	    bool not_found_ok	= getBoolValue (argmap, "not_found_ok");
-	    // when true, "dn" key is included in result map of each object
-	    bool include_dn	=  getBoolValue (argmap, "include_dn");
- 
-	    StringList attrs = ycplist2stringlist(getListValue(argmap,"attrs"));
+	    SearchArgs a	= search_args (argmap);
+	    stats.note ("base", a.base_dn);
+	    stats.note ("scope", a.scope);
+	    stats.note ("filter", a.filter);
+
+	    YCPValue cached	= cached_search (a);
+	    if (!cached.isNull ()) {
+		return cached;
+	    }
 			
 	    y2debug ("(search call) base:'%s', filter:'%s', scope:'%i'",
-		    base_dn.c_str(), filter.c_str(), scope);
+		    a.base_dn.c_str(), a.filter.c_str(), a.scope);
 	    // do the search call
-	    LDAPSearchResults* entries = NULL;
+	    LdapResults* entries = NULL;
 	    try {
-		entries = ldap->search (
-		    base_dn, scope, filter, attrs, attrsOnly, cons);
+		LdapStats::Wait wait (stats);
+		entries = search (a.base_dn, a.scope, a.filter, a.attrs,
+		    a.attrsOnly, cons);
 	    }
 	    catch  (LDAPException e) {
-		if (not_found_ok && e.getResultCode() == 32)
+		if (a.not_found_ok && e.getResultCode() == 32)
 		{
 		    y2debug ("object not found");
-		    if (return_map) return YCPMap();
-		    else	    return YCPList();
+		    return empty_result (a);
 		}
 		else
 		{
-		    debug_exception (e, "searching for " + base_dn);
+		    debug_exception (e, "searching for " + a.base_dn);
 		    return ret;
 		}
             }
 
-	    // return value is list or map of entries
-	    YCPList retlist;
-	    YCPMap retmap;
-
-	    // go throught result and generate return value
-	    if (entries != 0) {
-		LDAPEntry* entry = new LDAPEntry();
-		bool ok = true;
-		while (ok) {
-		    try {
-			entry = entries->getNext();
-			if (entry != 0) {
-			    string dn	= entry->getDN();
-			    y2debug ("dn: %s", entry->getDN().c_str());
-			    if (dn_only) {
-				retlist->add (YCPString (entry->getDN()));
-			    }
-			    else {
-				YCPMap e =getSearchedEntry(entry,single_values);
-				if (include_dn) {
-				    e->add (YCPString ("dn"), YCPString (dn));
-				}
-				if (return_map) {
-				    retmap->add (YCPString (entry->getDN()), e);
-				}
-				else
-				    retlist->add (e);
-			    }
-			}
-			else ok = false;
-			delete entry;
-		    }
-		    catch (LDAPReferralException e) {
-			debug_referral (e, "going through search result");
-		    }
-		    catch  (LDAPException e) {
-			debug_exception (e, "going through search result");
-		    }
-		}
-            }
-	    if (return_map) return retmap;
-	    else return retlist;
+	    return read_search (a, entries);
+	}
+	/**
+	 * list the children of given entry with information about their
+	 * subordinates; with "prefetch" > 0, children of the returned entries
+	 * are read in advance (up to given depth) for the next calls
+	 * Read(.ldap.children, $[ "dn": dn, "prefetch": 1 ]) -> list of maps
+	 */
+	else if (PC(0) == "children") {
+	    string dn		= getValue (argmap, "dn");
+	    int prefetch	= getIntValue (argmap, "prefetch", 0);
+	    try {
+		return getChildren (dn, prefetch);
+	    }
+	    catch (LDAPException e) {
+		debug_exception (e, "searching for children of " + dn);
+		return ret;
+	    }
 	}
 	/**
 	 * get the users map (previously searched by users.search)
@@ -704,17 +2609,104 @@ YCPValue LdapAgent::Read(const YCPPath &path, const YCPValue& arg, const YCPValu
 	else if (PC(0) == "groups") {
 	    return groups;
 	}
+	/**
+	 * get the entry returned by server for last Write call with
+	 * "return_entry" option (Post-Read control)
+	 * Read(.ldap.last_entry) -> map
+	 */
+	else if (PC(0) == "last_entry") {
+	    return last_entry;
+	}
 	else {
 	    y2error("Wrong path '%s' in Read().", path->toString().c_str());
 	}
     }
     else if (path->length() == 2) {
 
+	/**
+	 * more searches at once: all are sent before reading the results,
+	 * so the server processes them concurrently
+	 * Read(.ldap.search.multi, [ <search_map>, ... ]) -> list of results
+	 * (each one the same as the result of Read(.ldap.search), nil on error)
+	 */
+	if (PC(0) == "search" && PC(1) == "multi") {
+	    // start all searches...
+	    YCPList searches;
+	    if (!arg.isNull() && arg->isList())
+		searches = arg->asList();
+	    std::vector<SearchArgs> args;
+	    std::vector<YCPValue> results;
+	    for (int i = 0; i < searches->size (); i++) {
+		YCPMap m;
+		bool valid	= searches->value (i)->isMap ();
+		if (valid)
+		    m = searches->value (i)->asMap ();
+		args.push_back (search_args (m));
+		if (!valid) {
+		    // empty map would be the search of root DSE
+		    y2error ("search %i of multi search is not a map: %s", i,
+			searches->value (i)->toString().c_str());
+		    results.push_back (YCPVoid ());
+		    continue;
+		}
+		results.push_back (cached_search (args[i]));
+	    }
+	    std::vector<LdapResults*> started;
+	    for (unsigned i = 0; i < args.size (); i++) {
+		started.push_back (NULL);
+		if (!results[i].isNull ())
+		    continue;
+		const SearchArgs &a	= args[i];
+		y2debug ("(multi search call) base:'%s', filter:'%s', scope:'%i'",
+		    a.base_dn.c_str(), a.filter.c_str(), a.scope);
+		try {
+		    started[i] = search_async (a.base_dn, a.scope, a.filter,
+			a.attrs, a.attrsOnly, cons);
+		}
+		catch (LDAPException e) {
+		    if (a.not_found_ok && e.getResultCode() == 32) {
+			results[i] = empty_result (a);
+		    }
+		    else {
+			debug_exception (e, "searching for " + a.base_dn);
+			results[i] = YCPVoid ();
+		    }
+		}
+	    }
+	    // ... and collect the results
+	    YCPList retlist;
+	    for (unsigned i = 0; i < args.size (); i++) {
+		if (started[i])
+		    results[i] = read_search (args[i], started[i]);
+		retlist->add (results[i]);
+	    }
+	    return retlist;
+	}
+	/**
+	 * get the entry returned by server for last Write call with
+	 * "pre_read" option (Pre-Read control)
+	 * Read(.ldap.last_entry.pre_read) -> map
+	 */
+	else if (PC(0) == "last_entry" && PC(1) == "pre_read") {
+	    return last_pre_entry;
+	}
+	/**
+	 * get the statistics of entry and query caches
+	 * Read(.ldap.cache.stats) -> map
+	 */
+	else if (PC(0) == "cache" && PC(1) == "stats") {
+	    YCPMap retmap;
+	    retmap->add (YCPString ("entry"), entry_cache.stats ());
+	    retmap->add (YCPString ("query"), query_cache.stats ());
+	    retmap->add (YCPString ("tls"), tls_sessions.stats ());
+	    return retmap;
+	}
+
 	/**
 	 * get the map of object class with given name
 	 * Read(.ldap.schema.oc, $[ "name": name]) -> map
 	 */
-	if (PC(0) == "schema" && (PC(1) == "object_class" || PC(1) == "oc"))  {
+	else if (PC(0) == "schema" && (PC(1) == "object_class" || PC(1) == "oc"))  {
 
 	    if (!schema) {
 		y2error ("Schema not read! Use Execute(.ldap.schema) before.");
@@ -862,6 +2854,66 @@ YCPValue LdapAgent::Read(const YCPPath &path, const YCPValue& arg, const YCPValu
 	else if (PC(0) == "groups" && PC(1) == "items") {
 	    return group_items;
 	}
+	/**
+	 * get the groups of each user, including the groups it belongs to
+	 * through nested groups (users.search with "nested_groups")
+	 * Read(.ldap.users.effective_groups) -> map
+	 */
+	else if (PC(0) == "users" && PC(1) == "effective_groups") {
+	    return effective_groups;
+	}
+	/**
+	 * lowest "count" (default 1) UID's from "min" to "max" (default 1000
+	 * and 60000), not used by users found by users.search nor written
+	 * later (deleted ID's are freed with next users.search)
+	 * Read(.ldap.users.next_free_uid, $[ "min" : 1000, "max" : 60000,
+	 *	"count" : 1 ]) -> list
+	 */
+	else if (PC(0) == "users" && PC(1) == "next_free_uid") {
+	    return freeIds (uid_set, argmap);
+	}
+	/**
+	 * lowest GID's not used by groups found by users.search nor written
+	 * later, same as next_free_uid
+	 * Read(.ldap.groups.next_free_gid, $[ "min" : 1000 ]) -> list
+	 */
+	else if (PC(0) == "groups" && PC(1) == "next_free_gid") {
+	    return freeIds (gid_set, argmap);
+	}
+	/**
+	 * names of users having the value of attribute indexed by
+	 * users.search ("index_attrs"); without "value", whole index
+	 * (value -> list of names) is returned
+	 * Read(.ldap.users.by_attr, $[ "attr" : "mail",
+	 *	"value" : "jdoe@example.com", "ignore_case" : true ]) -> list
+	 */
+	else if (PC(0) == "users" && PC(1) == "by_attr") {
+	    return lookupUserIndex (argmap);
+	}
+	/**
+	 * names of users (previously searched by users.search) matching the
+	 * LDAP filter; values are compared with the users map
+	 * Read(.ldap.users.query, $[ "filter" :
+	 *	"(&(loginShell=/bin/bash)(gidNumber=100))" ]) -> list
+	 */
+	else if (PC(0) == "users" && PC(1) == "query") {
+	    return queryObjects (users, getValue (argmap, "filter"));
+	}
+	/**
+	 * names of groups matching the LDAP filter
+	 * Read(.ldap.groups.query, $[ "filter" : "(memberUid=jdoe)" ]) -> list
+	 */
+	else if (PC(0) == "groups" && PC(1) == "query") {
+	    return queryObjects (groups, getValue (argmap, "filter"));
+	}
+	/**
+	 * get the effective members (DN's) of each group: members of nested
+	 * groups are included, nested groups themselves are not
+	 * Read(.ldap.groups.effective_members) -> map
+	 */
+	else if (PC(0) == "groups" && PC(1) == "effective_members") {
+	    return effective_members;
+	}
 	else {
 	    y2error("Wrong path '%s' in Read().", path->toString().c_str());
 	}
@@ -922,6 +2974,7 @@ YCPBoolean LdapAgent::deleteSubTree (string dn) {
                 res=0;
             } else {
                 do {
+		    stats.received (entry, 0);
 		    deleteSubTree (entry->getDN ());
 		    y2debug ("deleting entry:'%s'", entry->getDN().c_str());
 		    try {
@@ -1050,6 +3103,7 @@ YCPBoolean LdapAgent::moveWithSubtree (string dn, string new_dn, string parent_d
 		string rdn	= child_dn.substr (0, child_dn.find (","));
 		child_dn	= rdn + "," + new_dn;
 
+		stats.received (entry, 0);
 		y2debug ("dn of children object: %s", entry->getDN().c_str());
 		ret = moveWithSubtree (entry->getDN(), child_dn, new_dn);
 	    }
@@ -1090,10 +3144,43 @@ YCPBoolean LdapAgent::moveWithSubtree (string dn, string new_dn, string parent_d
 }
 
 /**
- * Write
+ * Write: when the connection was lost, reconnect for the next calls;
+ * only idempotent calls (modify without renaming) are repeated, others
+ * might have been done already
  */
 YCPBoolean LdapAgent::Write(const YCPPath &path, const YCPValue& arg,
        const YCPValue& arg2)
+{
+    LdapStats::Span span (stats, "write" + path->toString());
+    expire_sessions ();
+    connection_lost	= false;
+    YCPBoolean ret	= writeOnce (path, arg, arg2);
+    span.failed (!ret->value ());
+    note_result (arg, !ret->value ());
+    if (!connection_lost || !reconnect (true))
+	return ret;
+
+    YCPMap argmap;
+    if (!arg.isNull() && arg->isMap())
+	argmap = arg->asMap();
+    bool idempotent	= path->length() == 1 &&
+	(PC(0) == "modify" || PC(0) == "edit") &&
+	getValue (argmap, "new_dn") == "" && getValue (argmap, "rdn") == "";
+    if (idempotent) {
+	y2milestone ("retrying Write (%s)", path->toString().c_str());
+	clear_error ();
+	ret	= writeOnce (path, arg, arg2);
+	span.failed (!ret->value ());
+	note_result (YCPNull (), !ret->value ());
+    }
+    return ret;
+}
+
+/**
+ * Write one time
+ */
+YCPBoolean LdapAgent::writeOnce(const YCPPath &path, const YCPValue& arg,
+       const YCPValue& arg2)
 {
     y2debug ("path in Write: '%s'.", path->toString().c_str());
 
@@ -1110,6 +3197,21 @@ YCPBoolean LdapAgent::Write(const YCPPath &path, const YCPValue& arg,
 	ldap_error = "init";
 	return YCPBoolean (false);
     }
+    if (ldif) {
+	y2error ("LDIF data are read-only");
+	ldap_error	= "LDIF data are read-only";
+	ldap_error_code	= LDAP_UNWILLING_TO_PERFORM;
+	return YCPBoolean (false);
+    }
+
+    // when true, server sends back the entry as it is after the change
+    // (Post-Read control), available via Read (.ldap.last_entry)
+    bool return_entry	= getBoolValue (argmap, "return_entry");
+    // when true, server sends back the entry as it was before the change
+    // (Pre-Read control), available via Read (.ldap.last_entry.pre_read)
+    bool pre_read	= getBoolValue (argmap, "pre_read");
+    last_entry		= YCPMap ();
+    last_pre_entry	= YCPMap ();
 
     if (path->length() == 1) {
 
@@ -1124,6 +3226,7 @@ YCPBoolean LdapAgent::Write(const YCPPath &path, const YCPValue& arg,
 		ldap_error = "missing_dn";
 		return YCPBoolean (false);
 	    }
+	    invalidate_cache (dn);
 	    // generate the list of attributes from parameters:
 	    LDAPAttributeList* attrs = new LDAPAttributeList();
 	    generate_attr_list (attrs, argmap2);
@@ -1131,12 +3234,22 @@ YCPBoolean LdapAgent::Write(const YCPPath &path, const YCPValue& arg,
 	    y2debug ("(add call) dn:'%s'", dn.c_str());
 	    LDAPEntry* entry = new LDAPEntry (dn, attrs);
 	    try {
-		ldap->add(entry);
+		LdapStats::Wait wait (stats);
+		if (return_entry) {
+		    LDAPConstraints read_cons (*cons);
+		    set_read_controls (&read_cons, argmap, false, true);
+		    finish_write (
+			ldap->LDAPAsynConnection::add (entry, &read_cons));
+		}
+		else
+		    ldap->add(entry);
 	    }
 	    catch (LDAPException e) {
 		debug_exception (e, "adding " + dn);
 		ret = YCPBoolean (false);
 	    }
+	    if (ret->value ())
+		noteWrittenIds (argmap2);
 	    delete attrs;
 	    return ret;
 	}
@@ -1173,10 +3286,20 @@ YCPBoolean LdapAgent::Write(const YCPPath &path, const YCPValue& arg,
 	    }
 	    string new_dn 	= getValue (argmap, "new_dn");
 	    string newParentDN	= getValue (argmap, "newParentDN");
+	    invalidate_cache (dn);
+	    if (new_dn != "") {
+		invalidate_cache (new_dn);
+	    }
 
 	    // check for possible object renaming
    	    if (new_dn != "" && getBoolValue (argmap, "subtree")) {
+		stats.begin ("moveWithSubtree");
+		stats.note ("dn", dn);
+		stats.note ("new_dn", new_dn);
 		ret = moveWithSubtree (dn, new_dn, newParentDN);
+		stats.end (ret->value ());
+		// entry was copied, there is no single operation to read from
+		pre_read	= false;
 	    }
 	    else {	
 		string rdn	= getValue (argmap, "rdn");
@@ -1186,7 +3309,17 @@ YCPBoolean LdapAgent::Write(const YCPPath &path, const YCPValue& arg,
 		if (rdn != "") {
 		    bool delOldRDN	= getBoolValue (argmap, "delOldRDN");
 		    try {
-			ldap->rename (dn, rdn, delOldRDN, newParentDN);
+			LdapStats::Wait wait (stats);
+			if (pre_read) {
+			    // original state is only known before renaming
+			    LDAPConstraints read_cons (*cons);
+			    set_read_controls (&read_cons, argmap, true, false);
+			    finish_write (ldap->LDAPAsynConnection::rename (
+				dn, rdn, delOldRDN, newParentDN, &read_cons));
+			    pre_read	= false;
+			}
+			else
+			    ldap->rename (dn, rdn, delOldRDN, newParentDN);
 		    }
 		    catch (LDAPException e) {
 			debug_exception (e, "renaming " + dn + " to " + rdn);
@@ -1209,13 +3342,22 @@ YCPBoolean LdapAgent::Write(const YCPPath &path, const YCPValue& arg,
 	    }
 	    y2debug ("(modify call) dn:'%s'", dn.c_str());
 	    try {
-		ldap->modify (dn, modlist);
+		LdapStats::Wait wait (stats);
+		if (pre_read || return_entry) {
+		    LDAPConstraints read_cons (*cons);
+		    set_read_controls (&read_cons, argmap, pre_read, return_entry);
+		    finish_write (ldap->LDAPAsynConnection::modify (
+			dn, modlist, &read_cons));
+		}
+		else
+		    ldap->modify (dn, modlist);
 	    }
 	    catch (LDAPException e) {
 		debug_exception (e, "modifying " + dn);
 		delete modlist;
 		return YCPBoolean (false);
 	    }
+	    noteWrittenIds (argmap2);
 	    delete modlist;
 	    return ret;
 	}
@@ -1231,15 +3373,26 @@ YCPBoolean LdapAgent::Write(const YCPPath &path, const YCPValue& arg,
 		return YCPBoolean (false);
 	    }
    	    bool delete_subtree = getBoolValue (argmap, "subtree");
+	    invalidate_cache (dn);
 	    if (delete_subtree) {
+		stats.begin ("deleteSubTree");
+		stats.note ("dn", dn);
 		ret = deleteSubTree (dn);
+		stats.end (ret->value ());
 	    }
 	    if (!ret->value()) {
 		return ret;
 	    }
 	    y2debug ("(delete call) dn:'%s'", dn.c_str());
 	    try {
-		ldap->del (dn);
+		LdapStats::Wait wait (stats);
+		if (pre_read) {
+		    LDAPConstraints read_cons (*cons);
+		    set_read_controls (&read_cons, argmap, true, false);
+		    finish_write (ldap->LDAPAsynConnection::del (dn, &read_cons));
+		}
+		else
+		    ldap->del (dn);
 	    }
 	    catch (LDAPException e) {
 		debug_exception (e, "deleting " + dn);
@@ -1258,10 +3411,41 @@ YCPBoolean LdapAgent::Write(const YCPPath &path, const YCPValue& arg,
 }
 
 /**
- * Execute
+ * Execute: reconnect when the connection was lost and retry the call
+ * if it was read-only action or bind
  */
 YCPValue LdapAgent::Execute(const YCPPath &path, const YCPValue& arg,
 	const YCPValue& arg2)
+{
+    LdapStats::Span span (stats, "execute" + (path->length() > 0 ? path->toString() : ""));
+    expire_sessions ();
+    connection_lost	= false;
+    YCPValue ret	= executeOnce (path, arg, arg2);
+    span.failed (failed (ret));
+    note_result (arg, failed (ret));
+    if (!connection_lost || path->length() == 0)
+	return ret;
+
+    bool retry	= PC(0) == "bind" || PC(0) == "schema" ||
+	(path->length() == 2 && PC(0) == "users" && PC(1) == "search");
+    bool reconnected = reconnect (false);
+    if (ldap_read != ldap)
+	reconnected = reconnect (true) && reconnected;
+    if (retry && reconnected) {
+	y2milestone ("retrying Execute (%s)", path->toString().c_str());
+	clear_error ();
+	ret	= executeOnce (path, arg, arg2);
+	span.failed (failed (ret));
+	note_result (YCPNull (), failed (ret));
+    }
+    return ret;
+}
+
+/**
+ * Execute one time
+ */
+YCPValue LdapAgent::executeOnce(const YCPPath &path, const YCPValue& arg,
+	const YCPValue& arg2)
 {
     y2debug ("path in Execute: '%s'.", path->toString().c_str());
     YCPValue ret = YCPBoolean (true);
@@ -1278,67 +3462,148 @@ YCPValue LdapAgent::Execute(const YCPPath &path, const YCPValue& arg,
 
 	ldap_initialized	= false;
 
-	hostname = getValue (argmap, "hostname");
-	if (hostname =="") {
-	    y2error ("Missing hostname of LDAPHost, aborting");
-	    return YCPBoolean (false);
-	}
+	// keep the current connection, it could be used again
+	park_session ();
+	session_timeout	= getIntValue (argmap, "session_timeout", SESSION_TIMEOUT);
+	expire_sessions ();
 
- 	port = getIntValue (argmap, "port", DEFAULT_PORT);
+	// optional cache of entries, disabled by default
+	entry_cache.configure (getIntValue (argmap, "cache_size", 0),
+	    getIntValue (argmap, "cache_ttl", 60));
+	query_cache.configure (getIntValue (argmap, "query_cache_size", 0),
+	    getIntValue (argmap, "query_cache_ttl", 60));
+	children_cache.configure (CHILDREN_CACHE_SIZE,
+	    getIntValue (argmap, "cache_ttl", 60));
 
-	// TODO how/where to set this?
-	cons = new LDAPConstraints;
+	// JSON lines trace of agent calls
+	stats.trace (getValue (argmap, "trace_file"));
+	// bytes of received entries in Read (.ldap.stats)
+	stats.volume (getBoolValue (argmap, "stats_bytes"));
+	// log of slow operations
+	stats.slow_log (getIntValue (argmap, "slow_threshold", 0),
+	    getIntValue (argmap, "slow_ops_size", SLOW_OPS_SIZE));
 
-	try {
-	    ldap = new LDAPConnection (hostname, port, cons);
+	// offline mode: data are read from LDIF file, not from server
+	delete ldif;
+	ldif	= NULL;
+	string ldif_file	= getValue (argmap, "ldif_file");
+	if (ldif_file != "") {
+	    ldif	= new LdifStore ();
+	    YCPList index	= getListValue (argmap, "ldif_index");
+	    for (int i = 0; i < index->size (); i++) {
+		if (index->value (i)->isString ())
+		    ldif->index (index->value (i)->asString ()->value ());
+	    }
+	    string ldif_schema	= getValue (argmap, "ldif_schema");
+	    if (!ldif->load (ldif_file) ||
+		(ldif_schema != "" && !ldif->load (ldif_schema))) {
+		ldap_error	= ldif->error ();
+		delete ldif;
+		ldif	= NULL;
+		return YCPBoolean (false);
+	    }
+	    ldap_initialized	= true;
+	    return YCPBoolean (true);
 	}
-	catch (LDAPException e) {
-	    debug_exception (e, "init");
-	    delete ldap;
-	    ldap	= NULL;
-	    y2error ("Error while initializing connection object");
-	    return YCPBoolean (false);
+
+	// parameters needed for opening new connections
+	conn_args	= argmap;
+	use_tls		= getValue (argmap, "use_tls");
+	bound		= false;
+	bind_dn		= "";
+	bind_pw		= "";
+	bind_mech	= "";
+
+	// list of servers: ordered list of URIs (or maps with "uri" and
+	// "weight"), or single "hostname" and "port"
+	servers.clear ();
+	YCPList uris	= getListValue (argmap, "uris");
+	for (int i = 0; i < uris->size (); i++) {
+	    LdapPingResult server;
+	    string uri;
+	    if (uris->value (i)->isString ()) {
+		uri	= uris->value (i)->asString ()->value ();
+	    }
+	    else if (uris->value (i)->isMap ()) {
+		uri	= getValue (uris->value (i)->asMap (), "uri");
+		server.weight	= getIntValue (uris->value (i)->asMap (), "weight", 1);
+	    }
+	    if (!ldap_parse_uri (uri, server)) {
+		y2error ("Wrong LDAP URI '%s'", uri.c_str());
+		continue;
+	    }
+	    servers.push_back (server);
+	}
+	if (servers.empty ()) {
+	    hostname = getValue (argmap, "hostname");
+	    if (hostname =="") {
+		y2error ("Missing hostname of LDAPHost, aborting");
+		return YCPBoolean (false);
+	    }
+	    port = getIntValue (argmap, "port", DEFAULT_PORT);
+	    LdapPingResult server (hostname, port);
+	    // hostname may be also URI, e.g. ldapi:// for local server
+	    if (hostname.find ("://") != string::npos &&
+		!ldap_parse_uri (hostname, server)) {
+		y2error ("Wrong LDAP URI '%s'", hostname.c_str());
+		return YCPBoolean (false);
+	    }
+	    servers.push_back (server);
+	}
+	// server for write operations, reads may go to other (closer) one
+	has_primary	= false;
+	string primary_uri	= getValue (argmap, "primary");
+	if (primary_uri != "") {
+	    has_primary	= ldap_parse_uri (primary_uri, primary);
+	    if (!has_primary) {
+		y2error ("Wrong LDAP URI '%s'", primary_uri.c_str());
+		return YCPBoolean (false);
+	    }
 	}
 
-	// start TLS if proper parameter is given
-	string tls	= getValue (argmap, "use_tls");
-        try {
-            set_tls_options (argmap, tls);
-        }
-        catch  (LDAPException e) {
-            debug_exception (e, "setting TLS options");
-            delete ldap;
-            ldap = NULL;
-            return YCPBoolean (false);
-        }
+	// TODO how/where to set this?
+	if (!cons) {
+	    cons = new LDAPConstraints;
+	}
 
-	if (tls == "try" || tls == "yes") {
-	    try {
-		ldap->start_tls ();
+	// connection with the same parameters may be still open
+	if (resume_session (connection_key (argmap))) {
+	    y2milestone ("reusing connection to %s:%i", hostname.c_str(), port);
+	    ldap_initialized	= true;
+	    return YCPBoolean (true);
+	}
+
+	// with more servers, choose the one with the lowest latency
+	current_server	= 0;
+	if (servers.size () > 1) {
+	    current_server = ldap_ping (servers,
+		getIntValue (argmap, "timeout", PING_TIMEOUT), false);
+	    if (current_server == -1) {
+		y2error ("None of LDAP servers is reachable");
+		ldap_error	= servers[0].error;
+		ldap_error_code	= servers[0].error_code;
+		return YCPBoolean (false);
 	    }
-	    catch  (LDAPException e) {
-		// check if starting TLS failed
-		debug_exception (e, "starting TLS");
-		delete ldap;
-		ldap	= NULL;
-		// return an error if TLS is required
-		if (tls == "yes") {
-		    tls_error	= true;
-		    return YCPBoolean (false);
-		}
-		ldap_error = "";
-		server_error = "";
-		ldap_error_code = 0;
-		// "try" -> start again, but without tls
-		ldap = new LDAPConnection (hostname, port, cons);
-		if (!ldap || !cons)
-		{
-		    y2error ("Error while initializing connection object");
-		    ldap_error 		= "init";
-		    return YCPBoolean (false);
-		}
+	    y2milestone ("using LDAP server %s:%i (%.1f ms)",
+		servers[current_server].host.c_str(),
+		servers[current_server].port, servers[current_server].latency);
+	}
+	hostname	= servers[current_server].host;
+	port		= servers[current_server].port;
+
+	ldap	= openConnection (servers[current_server]);
+	if (!ldap) {
+	    return YCPBoolean (false);
+	}
+	ldap_read	= ldap;
+	if (has_primary && !same_server (primary, servers[current_server])) {
+	    ldap	= openConnection (primary);
+	    if (!ldap) {
+		ldap	= ldap_read;
+		return YCPBoolean (false);
 	    }
 	}
+	session_key	= connection_key (argmap);
 	ldap_initialized = true;
 	return YCPBoolean (true);
     }
@@ -1354,34 +3619,81 @@ YCPValue LdapAgent::Execute(const YCPPath &path, const YCPValue& arg,
 	/**
 	 * ping: Execute (.ldap.ping, $[ "hostname": <host>, "port": <port> ] )
 	 * returns true if server is running
+	 *
+	 * Execute (.ldap.ping, $[ "hosts": [ "host1:389", "host2" ],
+	 *	"timeout": <ms>, "first": <bool> ])
+	 * checks all servers concurrently, returns map with the result
+	 * for each server and the fastest reachable one
 	 */
 	if (PC(0) == "ping") {
 
+	    if (!argmap->value (YCPString ("hosts")).isNull ()) {
+		YCPList hosts	= getListValue (argmap, "hosts");
+		int timeout	= getIntValue (argmap, "timeout", PING_TIMEOUT);
+		std::vector<LdapPingResult> servers;
+		for (int i = 0; i < hosts->size (); i++) {
+		    if (!hosts->value (i)->isString ())
+			continue;
+		    LdapPingResult server;
+		    if (!ldap_parse_uri (hosts->value (i)->asString ()->value (),
+			server)) {
+			y2error ("ping: wrong server specification '%s'",
+			    hosts->value (i)->asString ()->value ().c_str ());
+			continue;
+		    }
+		    servers.push_back (server);
+		}
+		int fastest = ldap_ping (servers, timeout,
+		    getBoolValue (argmap, "first"));
+
+		YCPList list;
+		for (unsigned i = 0; i < servers.size (); i++) {
+		    YCPMap server;
+		    server->add (YCPString ("hostname"), YCPString (servers[i].host));
+		    server->add (YCPString ("port"), YCPInteger (servers[i].port));
+		    if (servers[i].uri != "") {
+			server->add (YCPString ("uri"), YCPString (servers[i].uri));
+		    }
+		    server->add (YCPString ("reachable"),
+			YCPBoolean (servers[i].reachable));
+		    server->add (YCPString ("tls"), YCPBoolean (servers[i].tls));
+		    if (servers[i].finished) {
+			server->add (YCPString ("latency"),
+			    YCPFloat (servers[i].latency));
+		    }
+		    server->add (YCPString ("code"),
+			YCPInteger (servers[i].error_code));
+		    server->add (YCPString ("msg"), YCPString (servers[i].error));
+		    list->add (server);
+		}
+		YCPMap retmap;
+		retmap->add (YCPString ("servers"), list);
+		if (fastest != -1) {
+		    retmap->add (YCPString ("fastest"), list->value (fastest));
+		}
+		return retmap;
+	    }
+
 	    string host_tmp = getValue (argmap, "hostname");
 	    if (host_tmp == "") {
 		y2error ("Missing hostname of LDAPHost, aborting");
 		return YCPBoolean (false);
 	    }
-	    int port_tmp = getIntValue (argmap, "port", DEFAULT_PORT);
-
-	    LDAPConnection *ldap_tmp = new LDAPConnection (host_tmp, port_tmp);
-	    if (!ldap_tmp) {
-		delete ldap_tmp;
-		ldap_error = "init";
-		y2error ("ping: failed to create LDAPConnection object");
+	    LdapPingResult server (host_tmp,
+		getIntValue (argmap, "port", DEFAULT_PORT));
+	    if (host_tmp.find ("://") != string::npos &&
+		!ldap_parse_uri (host_tmp, server)) {
+		y2error ("Wrong LDAP URI '%s'", host_tmp.c_str());
 		return YCPBoolean (false);
 	    }
-	    LDAPSearchResults* entries = NULL;
-	    try {
-		entries = ldap_tmp->search ("");
-	    }
-	    catch  (LDAPException e) {
-		delete ldap_tmp;
-		debug_exception (e, "doing the ping");
+	    ldap_ping_one (server, getIntValue (argmap, "timeout", 0));
+	    if (!server.reachable) {
+		ldap_error	= server.error;
+		ldap_error_code	= server.error_code;
+		y2error ("ldap error while doing the ping (%i): %s",
+		    ldap_error_code, ldap_error.c_str());
 		return YCPBoolean (false);
-            }
-
-	    delete ldap_tmp;
+	    }
 	    return YCPBoolean(true);
 	}
 	/**
@@ -1446,32 +3758,72 @@ YCPValue LdapAgent::Execute(const YCPPath &path, const YCPValue& arg,
 	 */
 	else if (PC(0) == "bind") {
 
-	    bind_dn = getValue (argmap, "bind_dn");
-	    bind_pw = getValue (argmap, "bind_pw");
+	    // there is no identity to bind with for LDIF data
+	    if (ldif) {
+		return YCPBoolean (true);
+	    }
+
+	    string new_dn	= getValue (argmap, "bind_dn");
+	    string new_pw	= getValue (argmap, "bind_pw");
+	    string new_mech	= getValue (argmap, "sasl_mech");
+	    if (new_mech != "" && new_mech != "EXTERNAL") {
+		y2error ("Unsupported SASL mechanism %s", new_mech.c_str());
+		ldap_error	= "unsupported SASL mechanism";
+		return YCPBoolean (false);
+	    }
+	    bind_dn	= new_dn;
+	    bind_pw	= new_pw;
+	    bind_mech	= new_mech;
+	    // new identity may see different data
+	    entry_cache.clear ();
+	    query_cache.clear ();
+	    children_cache.clear ();
 			
 	    try {
-		ldap->bind (bind_dn, bind_pw, cons);
+		bindConnection (ldap);
+		tls_sessions.update (ldap->getSessionHandle ());
+		if (ldap_read != ldap) {
+		    bindConnection (ldap_read);
+		    tls_sessions.update (ldap_read->getSessionHandle ());
+		}
 	    }
 	    catch (LDAPException e) {
 		debug_exception (e, "binding with " + bind_dn);
 		return YCPBoolean (false);
 	    }
+	    // remember to bind again after reconnecting
+	    bound	= true;
 	    return YCPBoolean(true);
 	}
 	/**
 	 * unbind: Execute(.ldap.unbind)
 	 */
 	else if (PC(0) == "unbind") {
+	    if (ldif) {
+		return YCPBoolean (true);
+	    }
 	    ldap->unbind();
+	    if (ldap_read != ldap) {
+		ldap_read->unbind();
+	    }
+	    bound	= false;
+	    // connection is closed now, it cannot be used again
+	    session_key	= "";
 	    return YCPBoolean(true);
 	}
 	/** 
 	 * close the connection, delete object
 	 */
 	else if (PC(0) == "close") {
-	    ldap->unbind();
-	    delete ldap;
-	    ldap		= NULL;
+	    entry_cache.clear ();
+	    query_cache.clear ();
+	    children_cache.clear ();
+	    // connection stays open for session_timeout seconds, so next
+	    // Execute (.ldap) with the same parameters can use it
+	    park_session ();
+	    expire_sessions ();
+	    delete ldif;
+	    ldif		= NULL;
 	    ldap_initialized	= false;
 	    return YCPBoolean(true);
 	}
@@ -1485,9 +3837,9 @@ YCPValue LdapAgent::Execute(const YCPPath &path, const YCPValue& arg,
 	    StringList sl;
 	    sl.add ("objectclasses");
 	    sl.add ("attributetypes");
-	    LDAPSearchResults* entries = NULL;
+	    LdapResults* entries = NULL;
 	    try {
-		entries = ldap->search (schema_dn, 0, "objectClass=*", sl);
+		entries = search (schema_dn, 0, "objectClass=*", sl, false, NULL);
 	    }
 	    catch  (LDAPException e) {
 		debug_exception (e, "searching for " + schema_dn);
@@ -1504,14 +3856,48 @@ YCPValue LdapAgent::Execute(const YCPPath &path, const YCPValue& arg,
 			   ("attributetypes")->getValues());
 		}
 		delete entry;
+		delete entries;
 	    }
 	    return YCPBoolean (true);
 	}
+	/**
+	 * bulk import: Execute (.ldap.import, $[ "file": <ldif file>,
+	 *	"window": <n>, "connections": <n>, "stop_on_error": <bool> ])
+	 * returns map with numbers of processed records and failures
+	 */
+	else if (PC(0) == "import") {
+	    if (ldif) {
+		y2error ("LDIF data are read-only");
+		ldap_error	= "LDIF data are read-only";
+		ldap_error_code	= LDAP_UNWILLING_TO_PERFORM;
+		return YCPBoolean (false);
+	    }
+	    return importLdif (argmap);
+	}
+	/**
+	 * export: Execute (.ldap.export, $[ "base_dn": <dn>, "filter": <filter>,
+	 *	"scope": <n>, "attrs": <list>, "file": <ldif file> ])
+	 * returns map with numbers of exported entries and written bytes
+	 */
+	else if (PC(0) == "export") {
+	    return exportLdif (argmap);
+	}
 	else if (PC(0) == "start_tls") {
-	    
+
+	    // reused connection may already be secured
+	    if (tls_started || ldif) {
+		return YCPBoolean (true);
+	    }
 	    try {
 		set_tls_options (argmap, "yes");
 		ldap->start_tls ();
+		tls_sessions.update (ldap->getSessionHandle ());
+		if (ldap_read != ldap) {
+		    ldap_read->start_tls ();
+		    tls_sessions.update (ldap_read->getSessionHandle ());
+		}
+		tls_started	= true;
+		tls_args	= argmap;
 	    }
 	    catch  (LDAPException e) {
 		debug_exception (e, "starting TLS");
@@ -1533,8 +3919,9 @@ YCPValue LdapAgent::Execute(const YCPPath &path, const YCPValue& arg,
 	 * (more special work is done than in generic search)
 	 */
 	if (PC(0) == "users" && PC(1) == "search") {
-	    string user_base	= getValue (argmap, "user_base");
-	    string group_base	= getValue (argmap, "group_base");
+	    // bases may be also given as lists
+	    std::vector<string> user_bases	= dn_list (argmap, "user_base");
+	    std::vector<string> group_bases	= dn_list (argmap, "group_base");
 	    string user_filter	= getValue (argmap, "user_filter");
 	    string group_filter	= getValue (argmap, "group_filter");
 	    // which attribute have groups for list of members
@@ -1542,10 +3929,20 @@ YCPValue LdapAgent::Execute(const YCPPath &path, const YCPValue& arg,
 		getValue (argmap, "member_attribute");
 	    if (member_attribute == "")
 		member_attribute	= "uniqueMember";
+	    string member_attr	= tolower (member_attribute);
 
 	    int user_scope	= getIntValue (argmap, "user_scope", 2);
 	    int group_scope	= getIntValue (argmap, "group_scope", 2);
 	    bool itemlists	= getBoolValue (argmap, "itemlists");
+	    bool nested_groups	= getBoolValue (argmap, "nested_groups");
+	    // user attributes to build indexes for (Read (.ldap.users.by_attr))
+	    StringList index_list = ycplist2stringlist (
+		    getListValue(argmap, "index_attrs"));
+	    std::vector<string> index_attrs;
+	    for (StringList::const_iterator i = index_list.begin ();
+		 i != index_list.end (); i++) {
+		index_attrs.push_back (tolower (*i));
+	    }
 	    StringList user_attrs = ycplist2stringlist (
 		    getListValue(argmap, "user_attrs"));
    	    StringList group_attrs = ycplist2stringlist (
@@ -1557,25 +3954,27 @@ YCPValue LdapAgent::Execute(const YCPPath &path, const YCPValue& arg,
 	    map <string, string > s_grouplists;
 	    // for each group, store users having this group as default:
 	    map <int, YCPMap> more_usersmap;
+	    // for each user (normalized DN), its name (for nested groups)
+	    map <string, string> dn_usernames;
 
 	    // when true, no error message is written when object was not found
 	    bool not_found_ok	= true;
    
-	    // first, search for groups
-	    LDAPSearchResults* entries = NULL;
-	    try {
-		entries = ldap->search (group_base, group_scope, group_filter,
-		       group_attrs, false, cons);
+	    // first, search for groups; all searches are started at once,
+	    // so the server processes them while the groups are read
+	    stats.begin ("users.search/groups");
+	    stats.note ("base", join (group_bases, ";"));
+	    stats.note ("scope", group_scope);
+	    stats.note ("filter", group_filter);
+	    std::vector<LdapResults*> group_results, user_results;
+	    if (!search_bases (group_bases, group_scope, group_filter,
+		    group_attrs, group_results) ||
+		!search_bases (user_bases, user_scope, user_filter,
+		    user_attrs, user_results)) {
+		delete_results (group_results);
+		stats.end (false);
+		return YCPBoolean (false);
 	    }
-	    catch  (LDAPException e) {
-		if (not_found_ok && e.getResultCode() == 32) {
-		    y2warning ("groups not found");
-		}
-		else {
-		    debug_exception (e, "searching for " + group_base);
-		    return YCPBoolean (false);
-		}
-            }
 
 	    // initialize the maps/lists to be filled
 	    users = YCPMap();
@@ -1593,15 +3992,27 @@ YCPValue LdapAgent::Execute(const YCPPath &path, const YCPValue& arg,
 	    group_items = YCPMap();
 	    groupnames	= YCPMap();
 	    gids	= YCPMap();
+	    effective_groups	= YCPMap();
+	    effective_members	= YCPMap();
+	    user_indexes.clear ();
+	    uid_set.clear ();
+	    gid_set.clear ();
+	    for (unsigned i = 0; i < index_attrs.size (); i++)
+		user_indexes[index_attrs[i]]	= UserIndex ();
 
 	    // now generate group map (to use with users)
-	    if (entries != 0) {
+	    for (unsigned b = 0; b < group_results.size (); b++) {
+	    LdapResults *entries = group_results[b];
+	    group_results[b] = NULL;
 	    
 	    LDAPEntry* entry = new LDAPEntry();
 	    bool ok = true;
 	    while (ok) {
 	      try {
-		entry = entries->getNext();
+		{
+		    LdapStats::Wait wait (stats);
+		    entry = entries->getNext();
+		}
 		if (entry != 0) {
 		    YCPMap group = getGroupEntry (entry, member_attribute);
 		    group->add (YCPString("dn"), YCPString(entry->getDN()));
@@ -1613,27 +4024,46 @@ YCPValue LdapAgent::Execute(const YCPPath &path, const YCPValue& arg,
 		    }
 		    string groupname = getValue (group, "cn");
 		    
-		    // go through userlist of this group
-		    YCPList ul = getListValue (group, member_attribute);
+		    // go through userlist of this group, directly in the
+		    // entry; large groups may come in more ranges
 		    string s_ul;
 		    YCPMap usermap;
-		    for (int i=0; i < ul->size(); i++) {
+		    YCPString ygroupname (groupname);
+		    int next	= -1;
+		    const LDAPAttribute *members = member_values (
+			entry->getAttributes (), member_attr, next);
+		    LDAPEntry *range	= NULL;
+		    while (members != NULL) {
+		      const StringList &ul	= members->getValues ();
+		      for (StringList::const_iterator i = ul.begin ();
+			   i != ul.end (); i++) {
 			// For each user in userlist add this group to the
 			// map of type "user->his groups".
-			string udn = ul->value(i)->asString()->value();
-			(grouplists[udn])->add (YCPString (groupname), YCPInteger (1));
-			if (s_grouplists.find (udn) != s_grouplists.end())
-			    s_grouplists [udn] += ",";
-			s_grouplists[udn] += groupname;
-
+			const string &udn = *i;
+			(grouplists[udn])->add (ygroupname, YCPInteger (1));
 			if (itemlists) {
-			    string rest = udn.substr (udn.find ("=") + 1);
-			    string user = rest.substr (0, rest.find (","));
-			    if (i>0) s_ul += ",";
-			    s_ul += user;
+			    string &s_gl	= s_grouplists[udn];
+			    if (!s_gl.empty ())
+				s_gl += ",";
+			    s_gl += groupname;
+			    // table shows only ANSWER characters
+			    if (s_ul.size () <= ANSWER) {
+				string rest = udn.substr (udn.find ("=") + 1);
+				if (!s_ul.empty ()) s_ul += ",";
+				s_ul += rest.substr (0, rest.find (","));
+			    }
 			}
 			usermap->add (YCPString (udn), YCPInteger (1));
+		      }
+		      if (next == -1)
+			  break;
+		      delete range;
+		      range	= getMemberRange (entry->getDN (),
+			  member_attribute, next);
+		      members	= range ? member_values (range->getAttributes (),
+			  member_attr, next) : NULL;
 		    }
+		    delete range;
 		    group->add (YCPString (member_attribute), usermap);
 		    // change list of users to string (need only for itemlist)
 		    if (itemlists) {
@@ -1652,6 +4082,7 @@ YCPValue LdapAgent::Execute(const YCPPath &path, const YCPValue& arg,
 
 		    groupnames->add (YCPString (groupname), YCPInteger(1));
 		    gids->add (YCPInteger (gid), YCPInteger(1));
+		    gid_set.add (gid);
 		}
 		else ok = false;
 		delete entry;
@@ -1660,35 +4091,42 @@ YCPValue LdapAgent::Execute(const YCPPath &path, const YCPValue& arg,
 		debug_referral (e, "going through group search result");
 	      }
 	      catch  (LDAPException e) {
-		debug_exception (e, "going through group search result");
-	      }
-	    }
-            }
-	    
-	    // search for users
-	    entries = NULL;
-	    try {
-		entries = ldap->search (user_base, user_scope, user_filter,
-		       user_attrs, false, cons);
-	    }
-	    catch  (LDAPException e) {
 		if (not_found_ok && e.getResultCode() == 32) {
-		    y2warning ("users not found");
+		    y2warning ("groups not found in %s", group_bases[b].c_str());
 		}
 		else {
-		    debug_exception (e, "searching for " + user_base);
+		    debug_exception (e, "searching for " + group_bases[b]);
+		    delete entries;
+		    delete_results (group_results);
+		    delete_results (user_results);
+		    stats.end (false);
 		    return YCPBoolean (false);
 		}
+	      }
+	    }
+	    delete entries;
             }
+	    
+	    // search for users
+	    stats.end ();
+	    stats.begin ("users.search/users");
+	    stats.note ("base", join (user_bases, ";"));
+	    stats.note ("scope", user_scope);
+	    stats.note ("filter", user_filter);
 
 	    // go through user entries and generate maps
-	    if (entries != 0) {
+	    for (unsigned b = 0; b < user_results.size (); b++) {
+	    LdapResults *entries = user_results[b];
+	    user_results[b] = NULL;
 	    
 	    LDAPEntry* entry = new LDAPEntry();
 	    bool ok = true;
 	    while (ok) {
 	      try {
-		entry = entries->getNext();
+		{
+		    LdapStats::Wait wait (stats);
+		    entry = entries->getNext();
+		}
 		if (entry != 0) {
 		    // get the map of user
 		    YCPMap user = getUserEntry (entry);
@@ -1762,8 +4200,20 @@ YCPValue LdapAgent::Execute(const YCPPath &path, const YCPValue& arg,
 		    users_by_uidnumber->add (YCPInteger (uid), uids_map);
 
 		    uids->add (YCPInteger (uid), YCPInteger(1));
+		    uid_set.add (uid);
 		    usernames->add (YCPString (username), YCPInteger(1));
 		    userdns->add (YCPString (dn), YCPInteger(1));
+		    if (nested_groups)
+			dn_usernames[LdapCache::normalize_dn (dn)] = username;
+		    for (unsigned i = 0; i < index_attrs.size (); i++) {
+			std::vector<string> values;
+			YCPObject (user).values (index_attrs[i], values);
+			UserIndex &index	= user_indexes[index_attrs[i]];
+			for (unsigned j = 0; j < values.size (); j++) {
+			    index.exact[values[j]].push_back (username);
+			    index.nocase[tolower (values[j])].push_back (username);
+			}
+		    }
 		    string home = getValue (user,"homeDirectory");
 		    if (home != "") {
 			homes->add (YCPString (home), YCPInteger(1));
@@ -1776,11 +4226,23 @@ YCPValue LdapAgent::Execute(const YCPPath &path, const YCPValue& arg,
 		debug_referral (e, "going through user search result");
 	      }
 	      catch  (LDAPException e) {
-		debug_exception (e, "going through user search result");
+		if (not_found_ok && e.getResultCode() == 32) {
+		    y2warning ("users not found in %s", user_bases[b].c_str());
+		}
+		else {
+		    debug_exception (e, "searching for " + user_bases[b]);
+		    delete entries;
+		    delete_results (user_results);
+		    stats.end (false);
+		    return YCPBoolean (false);
+		}
 	      }
 	    }
+	    delete entries;
             }
 	    // once again, go through groups and update group maps	    
+	    stats.end ();
+	    stats.begin ("users.search/update");
 	    for (YCPMapIterator i = groups->begin(); i != groups->end(); i++) {
 
 		YCPMap group = i.value()->asMap();
@@ -1815,6 +4277,12 @@ YCPValue LdapAgent::Execute(const YCPPath &path, const YCPValue& arg,
 		    group_items->add (YCPString (groupname), item);
 		}
 	    }
+	    stats.end ();
+	    if (nested_groups) {
+		stats.begin ("users.search/nested");
+		resolveNestedGroups (member_attribute, dn_usernames);
+		stats.end ();
+	    }
 	    return YCPBoolean(true);
 	}
 	else {
@@ -40,15 +40,42 @@
 
 #include <LDAPSchema.h>
 
+#include <map>
+
+#include "LdapCache.h"
+#include "LdapStats.h"
+#include "LdapTlsCache.h"
+#include "LdapPing.h"
+#include "LdapLdif.h"
+#include "LdapIdSet.h"
+
 #define DEFAULT_PORT 389
 #define ANSWER	42
 #define MAX_LENGTH_ID 5
+// default deadline (ms) for checking more servers by Execute(.ldap.ping)
+#define PING_TIMEOUT 3000
+// number of kept slow operations (see Read(.ldap.slow_ops))
+#define SLOW_OPS_SIZE 100
+// how long (seconds) closed connection stays open for reuse
+#define SESSION_TIMEOUT 300
+// maximal number of connections kept for reuse
+#define MAX_SESSIONS 4
+// maximal number of prefetched child lists
+#define CHILDREN_CACHE_SIZE 1000
+// default number of Execute(.ldap.import) operations waiting for result
+// on one connection
+#define IMPORT_WINDOW 16
+// default page size of Execute(.ldap.export) searches
+#define EXPORT_PAGE_SIZE 500
 
 /**
  * @short An interface class between YaST2 and Ldap Agent
  */
 class LdapAgent : public SCRAgent
 {
+    // microbenchmarks of the conversion methods (LdapMicroBench.cc)
+    friend class LdapMicroBench;
+
 private:
     /**
      * Agent private variables
@@ -57,6 +84,8 @@ private:
     string hostname;
     string bind_dn;
     string bind_pw;
+    // SASL mechanism of the bind, empty for simple bind
+    string bind_mech;
     string ldap_error;
     string server_error;
     bool tls_error;
@@ -66,8 +95,126 @@ private:
 
     string userpw_hash;
 
+    /**
+     * connection for write operations (and for everything when there is
+     * no special primary server)
+     */
     LDAPConnection *ldap;
+    /**
+     * connection for read operations, the same as ldap or connection to
+     * closer replica
+     */
+    LDAPConnection *ldap_read;
     LDAPConstraints *cons;
+
+    /**
+     * offline data from LDIF file (Execute (.ldap) with "ldif_file"),
+     * used instead of the connections when not NULL
+     */
+    LdifStore *ldif;
+
+    /**
+     * configured servers and index of the one used for reading
+     */
+    std::vector<LdapPingResult> servers;
+    int current_server;
+
+    /**
+     * server for write operations (if has_primary is true)
+     */
+    LdapPingResult primary;
+    bool has_primary;
+
+    /**
+     * parameters of Execute (.ldap) and bind state, needed for reconnecting
+     */
+    YCPMap conn_args;
+    // TLS parameters of explicit Execute (.ldap.start_tls)
+    YCPMap tls_args;
+    string use_tls;
+    bool bound;
+
+    /**
+     * set when the connection to server failed during current call
+     */
+    bool connection_lost;
+
+    /**
+     * connection kept open after Execute (.ldap.close) or new
+     * Execute (.ldap), it is used again when the parameters are the same
+     */
+    struct Session {
+	LDAPConnection	*ldap;
+	LDAPConnection	*ldap_read;
+	std::vector<LdapPingResult> servers;
+	int		current_server;
+	bool		bound;
+	bool		tls_started;
+	YCPMap		tls_args;
+	time_t		last_used;
+    };
+    std::multimap<string, Session> sessions;
+
+    /**
+     * parameters of Read (.ldap.search) and of caching its result
+     */
+    struct SearchArgs {
+	string		base_dn;
+	string		filter;
+	int		scope;
+	StringList	attrs;
+	bool		attrsOnly;
+	bool		return_map;
+	bool		single_values;
+	bool		dn_only;
+	bool		not_found_ok;
+	bool		include_dn;
+	bool		table;
+	bool		columns;
+	// result may be taken from (and stored to) entry_cache/query_cache
+	bool		use_cache;
+	bool		use_query_cache;
+	string		spec;
+	string		query_spec;
+    };
+
+    /**
+     * search result in "table" format being read: attribute names,
+     * lower-case names mapped to columns, number of entries and the rows
+     * or the columns (with nil for missing values; rows read before new
+     * attribute was found are shorter)
+     */
+    struct SearchTable {
+	std::vector<string> names;
+	std::map<string, unsigned> columns;
+	int count;
+	YCPList rows;
+	std::vector<YCPList> column_lists;
+    };
+
+    /**
+     * operation of Execute (.ldap.import) waiting for its result
+     */
+    struct ImportOp {
+	LDAPMessageQueue *q;
+	// DN as in the file, normalized DN and new DN (after rename)
+	string		dn;
+	string		ndn;
+	string		new_dn;
+	// line of the record in the file
+	int		line;
+	// "added", "modified", "deleted" or "renamed"
+	string		type;
+    };
+
+    /**
+     * key of current connection parameters (empty if connection cannot be
+     * reused) and number of seconds unused session is kept; tls_started
+     * is set after explicit Execute (.ldap.start_tls)
+     */
+    string session_key;
+    bool tls_started;
+    int session_timeout;
     LDAPSchema *schema;
 
     YCPMap  users,
@@ -85,6 +232,60 @@ private:
 	    gids,
 	    group_items;
 
+    /**
+     * effective memberships computed by users.search with "nested_groups"
+     * (user name -> groups, group name -> member DN's)
+     */
+    YCPMap  effective_groups,
+	    effective_members;
+
+    /**
+     * indexes of user attributes named in "index_attrs" of users.search
+     * (lower-case attribute name): values mapped to user names, exact and
+     * lower-case values
+     */
+    struct UserIndex {
+	std::map<string, std::vector<string> > exact;
+	std::map<string, std::vector<string> > nocase;
+    };
+    std::map<string, UserIndex> user_indexes;
+
+    /**
+     * UID's and GID's found by users.search and written since then
+     */
+    LdapIdSet uid_set, gid_set;
+
+    /**
+     * entries returned by Pre-Read/Post-Read controls of last Write call
+     */
+    YCPMap  last_entry,
+	    last_pre_entry;
+
+    /**
+     * cache of entries read by base-scope searches
+     */
+    LdapCache entry_cache;
+
+    /**
+     * cache of results of other searches
+     */
+    LdapCache query_cache;
+
+    /**
+     * prefetched lists of children (see Read(.ldap.children))
+     */
+    LdapCache children_cache;
+
+    /**
+     * TLS sessions of servers, resumed by new connections
+     */
+    LdapTlsCache tls_sessions;
+
+    /**
+     * statistics of agent calls (see Read(.ldap.stats))
+     */
+    LdapStats stats;
+
     /**
      * search the map for value of given key; both key and value have to be strings
      * when key is not present, empty string is returned
@@ -125,6 +326,53 @@ private:
      */
     YCPMap getGroupEntry (LDAPEntry *entry, string member_attribute);
 
+    /**
+     * Return next range of group members ("member;range=from-*")
+     * @param dn DN of the group
+     * @param member_attribute name of attribute with members
+     * @param from index of first value of the range
+     * @return entry with the range (delete it), NULL on error
+     */
+    LDAPEntry* getMemberRange (string dn, string member_attribute, int from);
+
+    /**
+     * Names of users or groups (keys of the map) matching the filter
+     * @param objects users or groups map
+     * @param filter LDAP search filter
+     * @return list of names, nil for invalid filter
+     */
+    YCPValue queryObjects (YCPMap objects, string filter);
+
+    /**
+     * Look up users by value of indexed attribute
+     * @param argmap map with "attr", "value" and "ignore_case"
+     * @return list of user names (map of values to names without
+     * "value"), nil if the attribute was not indexed
+     */
+    YCPValue lookupUserIndex (YCPMap argmap);
+
+    /**
+     * Mark uidNumber and gidNumber of written entry as allocated
+     * @param attrs map of attributes of Write (.ldap.add/modify)
+     */
+    void noteWrittenIds (YCPMap attrs);
+
+    /**
+     * Find free UID's or GID's
+     * @param ids allocated ID's
+     * @param argmap map with "min", "max" and "count"
+     * @return list of free ID's
+     */
+    YCPList freeIds (const LdapIdSet &ids, YCPMap argmap);
+
+    /**
+     * Fill effective_groups and effective_members from groups map
+     * @param member_attribute name of attribute with members
+     * @param dn_usernames normalized DN's of users mapped to their names
+     */
+    void resolveNestedGroups (string member_attribute,
+	const std::map<string, string> &dn_usernames);
+
     /**
      * Return YCP of user, given as LDAP object
      * @param entry LDAP object of the user [item of search result]
@@ -136,7 +384,14 @@ private:
      * @param single_values if true, return string when argument has only
      * one value (otherwise return always list)
      */
-    YCPMap getSearchedEntry (LDAPEntry *entry, bool sinlge_value);
+    YCPMap getSearchedEntry (const LDAPEntry *entry, bool sinlge_value);
+
+    /**
+     * converts values of one attribute of searched object
+     * @param single_values if true, return string when attribute has only
+     * one value (otherwise return always list)
+     */
+    YCPValue getAttributeValue (const LDAPAttribute &attr, bool single_values);
 
     /**
      * searches for one object and gets all his non-empty attributes
@@ -145,6 +400,105 @@ private:
      */
     YCPMap getObjectAttributes (string dn);
 
+    /**
+     * Return YCP of child entry: its DN and subordinates information
+     * @param entry LDAP object with hasSubordinates/numSubordinates attributes
+     */
+    YCPMap getChildEntry (const LDAPEntry *entry);
+
+    /**
+     * search the LDIF data or the server (the read connection);
+     * throws LDAPException on error
+     * @return results to be deleted by the caller
+     */
+    LdapResults* search (string base, int scope, string filter,
+	StringList attrs, bool attrsOnly, const LDAPConstraints *c);
+
+    /**
+     * start the searches of all bases (missing base is skipped), add
+     * them to results
+     * @return false on error
+     */
+    bool search_bases (const std::vector<string> &bases, int scope,
+	const string &filter, const StringList &attrs,
+	std::vector<LdapResults*> &results);
+
+    /**
+     * start the search without waiting for the results (LDIF data are
+     * searched at once); throws LDAPException on error
+     * @return results to be deleted by the caller
+     */
+    LdapResults* search_async (string base, int scope, string filter,
+	StringList attrs, bool attrsOnly, const LDAPConstraints *c);
+
+    /**
+     * read the parameters of search from the map of Read (.ldap.search)
+     */
+    SearchArgs search_args (YCPMap argmap);
+
+    /**
+     * @return cached result of the search, YCPNull if there is none
+     */
+    YCPValue cached_search (const SearchArgs &a);
+
+    /**
+     * convert the found entry and add it to the result list or map
+     */
+    void add_search_entry (const SearchArgs &a, const LDAPEntry *entry,
+	YCPList &retlist, YCPMap &retmap);
+
+    /**
+     * add the found entry as a row of "table" result
+     */
+    void add_table_entry (const SearchArgs &a, const LDAPEntry *entry,
+	SearchTable &table);
+
+    /**
+     * @return "table" result: map with "attrs" and "rows" (or "columns")
+     */
+    YCPMap table_result (const SearchArgs &a, const SearchTable &table);
+
+    /**
+     * add "dn" and requested attributes as first columns of the table
+     */
+    void init_table (const SearchArgs &a, SearchTable &table);
+
+    /**
+     * @return empty result of the search (list, map or table)
+     */
+    YCPValue empty_result (const SearchArgs &a);
+
+    /**
+     * @return result of the search (list or map); complete one is stored
+     * to the query cache
+     */
+    YCPValue search_result (const SearchArgs &a, const YCPList &retlist,
+	const YCPMap &retmap, bool complete);
+
+    /**
+     * read the entries of the search result (and delete it)
+     * @return the same value as Read (.ldap.search), nil on error
+     */
+    YCPValue read_search (const SearchArgs &a, LdapResults *entries);
+
+    /**
+     * start asynchronous one-level search for children of given entry
+     */
+    LDAPMessageQueue* searchChildren (string dn);
+
+    /**
+     * read the result of asynchronous one-level search started by
+     * searchChildren; throws LDAPException on error
+     * @return list of maps created by getChildEntry
+     */
+    YCPList readChildren (LDAPMessageQueue *q);
+
+    /**
+     * get the list of children of given entry, prefetch the children
+     * of returned entries up to given depth into children_cache
+     */
+    YCPList getChildren (string dn, int prefetch);
+
     /**
      * deletes all children of given entry
      */
@@ -166,6 +520,162 @@ private:
      */
     YCPBoolean copyOneEntry (string dn, string new_dn);
  
+    /**
+     * Return YCP of entry sent by server in Pre-Read or Post-Read control
+     * (RFC 4527)
+     * @param ctrl response control
+     */
+    YCPMap getControlEntry (const LDAPCtrl &ctrl);
+
+    /**
+     * add Pre-Read and/or Post-Read request controls to constraints
+     * (attributes are taken from "return_attrs" list of args, default "*")
+     */
+    void set_read_controls (LDAPConstraints *c, YCPMap args, bool pre_read,
+	bool post_read);
+
+    /**
+     * wait for the result of asynchronous write operation and save entries
+     * from Pre-Read/Post-Read controls; throws LDAPException on error
+     */
+    void finish_write (LDAPMessageQueue *q);
+
+    /**
+     * import LDIF file: stream its records into write operations
+     * @return summary map or false when import cannot start
+     */
+    YCPValue importLdif (YCPMap args);
+
+    /**
+     * start asynchronous write operation of LDIF record, set its type
+     * and new DN; throws LDAPException when the record is wrong
+     */
+    LDAPMessageQueue* import_record (LDAPConnection *conn, const string &dn,
+	const LdifValues &values, string &type, string &new_dn);
+
+    /**
+     * wait for the result of import operation, add failure to errors
+     * @return false if the operation failed
+     */
+    bool finish_import (ImportOp &op, YCPList &errors);
+
+    /**
+     * export subtree to LDIF file
+     * @return summary map or false on error
+     */
+    YCPValue exportLdif (YCPMap args);
+
+    /**
+     * page through the search result on the read connection and write
+     * the entries from BER values of the messages; throws LDAPException
+     * on error
+     * @return number of pages
+     */
+    int export_pages (LdifWriter &writer, const string &base, int scope,
+	const string &filter, const StringList &attrs, int page_size);
+
+    /**
+     * drop cached search results affected by the change of given entry
+     */
+    void invalidate_cache (string dn);
+
+    /**
+     * reset the information about last error
+     */
+    void clear_error ();
+
+    /**
+     * check if both structures describe the same server
+     */
+    static bool same_server (const LdapPingResult &a, const LdapPingResult &b);
+
+    /**
+     * create new connection to given server, start TLS according to
+     * parameters of Execute (.ldap) and bind again if bind was done before
+     * @return NULL on error
+     */
+    LDAPConnection* openConnection (const LdapPingResult &server);
+
+    /**
+     * unbind and delete connection objects
+     */
+    void closeConnections (LDAPConnection *conn, LDAPConnection *conn_read);
+
+    /**
+     * create the key of connection parameters of Execute (.ldap) call
+     */
+    string connection_key (YCPMap args);
+
+    /**
+     * keep current connection for the next Execute (.ldap) with the same
+     * parameters (or close it, if it cannot be used again)
+     */
+    void park_session ();
+
+    /**
+     * take kept connection with given key, if there is one
+     * @return true if connection was found
+     */
+    bool resume_session (string key);
+
+    /**
+     * close kept connections not used for longer than session_timeout
+     */
+    void expire_sessions ();
+
+    /**
+     * set socket options of new connection: connect timeout, TCP
+     * keepalive and TLS session resumption
+     */
+    void set_connection_options (LDAPConnection *conn,
+	const LdapPingResult &server);
+
+    /**
+     * check if the return value of agent call means an error
+     */
+    static bool failed (const YCPValue &ret);
+
+    /**
+     * add DN of the call and the result to current trace record
+     */
+    void note_result (const YCPValue &arg, bool failure);
+
+    /**
+     * bind the connection with current credentials (simple or SASL EXTERNAL)
+     */
+    void bindConnection (LDAPConnection *conn);
+
+    /**
+     * key of the server in TLS session cache
+     */
+    string tls_key (const LdapPingResult &server);
+
+    /**
+     * open new connection to given server and check that it works
+     * @return NULL if server is not reachable
+     */
+    LDAPConnection* reopenConnection (const LdapPingResult &server);
+
+    /**
+     * replace lost connection by new one, with the same TLS settings and
+     * bind: for writes, reconnect to primary server; for reads, try the
+     * same server and then the best reachable one
+     * @param write true if connection for write operations was lost
+     * @return true if new connection was created
+     */
+    bool reconnect (bool write);
+
+    /**
+     * implementation of Read, Write and Execute, called once more
+     * after reconnecting
+     */
+    YCPValue readOnce (const YCPPath &path, const YCPValue& arg,
+	const YCPValue& opt);
+    YCPBoolean writeOnce (const YCPPath &path, const YCPValue& arg,
+	const YCPValue& arg2);
+    YCPValue executeOnce (const YCPPath &path, const YCPValue& arg,
+	const YCPValue& arg2);
+
     /**
      * log the output of an exception and set the return value from agent's call
      */
@@ -0,0 +1,309 @@
+/* ------------------------------------------------------------------------------
+ * Copyright (c) 2026 SUSE LLC. All Rights Reserved.
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, contact SUSE LLC.
+ * ------------------------------------------------------------------------------
+ */
+/* LdapBench.cc
+ *
+ * Benchmark of Ldap agent: drives the agent directly against running
+ * LDAP server filled by ldap-bench.sh and reports throughput, latency
+ * and memory usage
+ *
+ * $Id$
+ */
+
+#include "LdapAgent.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <vector>
+
+/**
+ * latencies of one benchmark phase
+ */
+struct Phase
+{
+    string		name;
+    std::vector<double>	latencies;
+    double		total;
+    int			errors;
+
+    Phase (const string &n) : name (n), total (0), errors (0) {}
+};
+
+static std::vector<Phase> phases;
+
+static string uri	= "ldap://127.0.0.1:38999";
+static string base	= "dc=bench";
+static string bind_dn	= "cn=admin,dc=bench";
+static string bind_pw	= "secret";
+static int users	= 10000;
+static int repeat	= 5;
+static int lookups	= 1000;
+static int writes	= 1000;
+
+/**
+ * peak resident set size in kB
+ */
+static long peak_rss ()
+{
+    struct rusage usage;
+    getrusage (RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static double percentile (std::vector<double> &sorted, double p)
+{
+    if (sorted.empty ())
+	return 0;
+    unsigned i = (unsigned) (p * (sorted.size () - 1) + 0.5);
+    return sorted[i];
+}
+
+/**
+ * run the operation, measure it and add the result to the last phase
+ */
+static YCPValue measure (bool ok_only, YCPValue (*op) (LdapAgent &, void *),
+    LdapAgent &agent, void *data)
+{
+    double start	= LdapStats::now ();
+    YCPValue ret	= op (agent, data);
+    double ms		= LdapStats::now () - start;
+    Phase &phase	= phases.back ();
+    phase.latencies.push_back (ms);
+    phase.total		+= ms;
+    if (ret.isNull () || ret->isVoid () ||
+	(ok_only && ret->isBoolean () && !ret->asBoolean ()->value ()))
+	phase.errors++;
+    return ret;
+}
+
+static string user_dn (int i)
+{
+    char buf[64];
+    snprintf (buf, sizeof (buf), "uid=user%d,ou=people,", i);
+    return buf + base;
+}
+
+// ------------------------- operations
+
+static YCPValue users_search (LdapAgent &agent, void *)
+{
+    YCPMap args;
+    args->add (YCPString ("user_base"), YCPString ("ou=people," + base));
+    args->add (YCPString ("group_base"), YCPString ("ou=groups," + base));
+    args->add (YCPString ("user_filter"), YCPString ("objectClass=posixAccount"));
+    args->add (YCPString ("group_filter"), YCPString ("objectClass=posixGroup"));
+    args->add (YCPString ("member_attribute"), YCPString ("uniqueMember"));
+    args->add (YCPString ("itemlists"), YCPBoolean (true));
+    return agent.Execute (YCPPath (".users.search"), args, YCPNull ());
+}
+
+static YCPValue read_entry (LdapAgent &agent, void *data)
+{
+    YCPMap args;
+    args->add (YCPString ("base_dn"), YCPString (user_dn (*(int *) data)));
+    args->add (YCPString ("no_cache"), YCPBoolean (true));
+    return agent.Read (YCPPath (".search"), args, YCPNull ());
+}
+
+static YCPValue read_filter (LdapAgent &agent, void *data)
+{
+    char filter[64];
+    snprintf (filter, sizeof (filter), "(uidNumber=%d)", 10000 + *(int *) data);
+    YCPMap args;
+    args->add (YCPString ("base_dn"), YCPString (base));
+    args->add (YCPString ("scope"), YCPInteger (2));
+    args->add (YCPString ("filter"), YCPString (filter));
+    args->add (YCPString ("no_cache"), YCPBoolean (true));
+    return agent.Read (YCPPath (".search"), args, YCPNull ());
+}
+
+static YCPValue read_subtree (LdapAgent &agent, void *)
+{
+    YCPList attrs;
+    attrs->add (YCPString ("uid"));
+    attrs->add (YCPString ("uidNumber"));
+    YCPMap args;
+    args->add (YCPString ("base_dn"), YCPString ("ou=people," + base));
+    args->add (YCPString ("scope"), YCPInteger (2));
+    args->add (YCPString ("filter"), YCPString ("objectClass=posixAccount"));
+    args->add (YCPString ("attrs"), attrs);
+    args->add (YCPString ("no_cache"), YCPBoolean (true));
+    return agent.Read (YCPPath (".search"), args, YCPNull ());
+}
+
+static YCPValue add_entry (LdapAgent &agent, void *data)
+{
+    int i	= *(int *) data;
+    char uid[32];
+    snprintf (uid, sizeof (uid), "bench%d", i);
+    YCPList oc;
+    oc->add (YCPString ("inetOrgPerson"));
+    oc->add (YCPString ("posixAccount"));
+    YCPMap entry;
+    entry->add (YCPString ("objectClass"), oc);
+    entry->add (YCPString ("uid"), YCPString (uid));
+    entry->add (YCPString ("cn"), YCPString (uid));
+    entry->add (YCPString ("sn"), YCPString (uid));
+    entry->add (YCPString ("uidNumber"), YCPString (YCPInteger (5000000 + i)->toString ()));
+    entry->add (YCPString ("gidNumber"), YCPString ("100"));
+    entry->add (YCPString ("homeDirectory"), YCPString (string ("/home/") + uid));
+    YCPMap args;
+    args->add (YCPString ("dn"), YCPString ("uid=" + string (uid) + ",ou=bench," + base));
+    return agent.Write (YCPPath (".add"), args, entry);
+}
+
+static YCPValue modify_entry (LdapAgent &agent, void *data)
+{
+    char uid[32];
+    snprintf (uid, sizeof (uid), "bench%d", *(int *) data);
+    YCPMap entry;
+    entry->add (YCPString ("loginShell"), YCPString ("/bin/bash"));
+    YCPMap args;
+    args->add (YCPString ("dn"), YCPString ("uid=" + string (uid) + ",ou=bench," + base));
+    return agent.Write (YCPPath (".modify"), args, entry);
+}
+
+static YCPValue add_container (LdapAgent &agent, void *)
+{
+    YCPList oc;
+    oc->add (YCPString ("organizationalUnit"));
+    YCPMap entry;
+    entry->add (YCPString ("objectClass"), oc);
+    entry->add (YCPString ("ou"), YCPString ("bench"));
+    YCPMap args;
+    args->add (YCPString ("dn"), YCPString ("ou=bench," + base));
+    return agent.Write (YCPPath (".add"), args, entry);
+}
+
+static YCPValue move_subtree (LdapAgent &agent, void *)
+{
+    YCPMap args;
+    args->add (YCPString ("dn"), YCPString ("ou=bench," + base));
+    args->add (YCPString ("new_dn"), YCPString ("ou=bench2," + base));
+    args->add (YCPString ("subtree"), YCPBoolean (true));
+    return agent.Write (YCPPath (".modify"), args, YCPMap ());
+}
+
+static YCPValue delete_subtree (LdapAgent &agent, void *)
+{
+    YCPMap args;
+    args->add (YCPString ("dn"), YCPString ("ou=bench2," + base));
+    args->add (YCPString ("subtree"), YCPBoolean (true));
+    return agent.Write (YCPPath (".delete"), args, YCPNull ());
+}
+
+// ------------------------- report
+
+static void report ()
+{
+    printf ("# users=%d uri=%s\n", users, uri.c_str ());
+    printf ("%-20s %8s %7s %10s %10s %9s %9s %9s\n", "phase", "ops", "errors",
+	"total_s", "ops/s", "p50_ms", "p95_ms", "p99_ms");
+    for (unsigned i = 0; i < phases.size (); i++) {
+	Phase &p	= phases[i];
+	std::sort (p.latencies.begin (), p.latencies.end ());
+	printf ("%-20s %8u %7d %10.3f %10.1f %9.3f %9.3f %9.3f\n",
+	    p.name.c_str (), (unsigned) p.latencies.size (), p.errors,
+	    p.total / 1000, p.total > 0 ? p.latencies.size () * 1000 / p.total : 0,
+	    percentile (p.latencies, 0.50), percentile (p.latencies, 0.95),
+	    percentile (p.latencies, 0.99));
+    }
+    printf ("peak_rss_kb %ld\n", peak_rss ());
+}
+
+static void usage (const char *name)
+{
+    fprintf (stderr, "Usage: %s [-H uri] [-b base] [-D bind_dn] [-w bind_pw]\n"
+	"\t[-n users] [-r repeat] [-l lookups] [-W writes]\n", name);
+    exit (1);
+}
+
+int main (int argc, char *argv[])
+{
+    int c;
+    while ((c = getopt (argc, argv, "H:b:D:w:n:r:l:W:")) != -1) {
+	switch (c) {
+	    case 'H': uri	= optarg; break;
+	    case 'b': base	= optarg; break;
+	    case 'D': bind_dn	= optarg; break;
+	    case 'w': bind_pw	= optarg; break;
+	    case 'n': users	= atoi (optarg); break;
+	    case 'r': repeat	= atoi (optarg); break;
+	    case 'l': lookups	= atoi (optarg); break;
+	    case 'W': writes	= atoi (optarg); break;
+	    default: usage (argv[0]);
+	}
+    }
+    if (users <= 0)
+	usage (argv[0]);
+
+    LdapAgent agent;
+    YCPMap init;
+    init->add (YCPString ("hostname"), YCPString (uri));
+    if (!agent.Execute (YCPPath ("."), init, YCPNull ())->asBoolean ()->value ()) {
+	fprintf (stderr, "cannot connect to %s\n", uri.c_str ());
+	return 1;
+    }
+    YCPMap bind;
+    bind->add (YCPString ("bind_dn"), YCPString (bind_dn));
+    bind->add (YCPString ("bind_pw"), YCPString (bind_pw));
+    if (!agent.Execute (YCPPath (".bind"), bind, YCPNull ())->asBoolean ()->value ()) {
+	fprintf (stderr, "cannot bind as %s\n", bind_dn.c_str ());
+	return 1;
+    }
+
+    phases.push_back (Phase ("users.search"));
+    for (int i = 0; i < repeat; i++)
+	measure (true, users_search, agent, NULL);
+
+    phases.push_back (Phase ("search.entry"));
+    for (int i = 0; i < lookups; i++) {
+	int n	= rand () % users;
+	measure (true, read_entry, agent, &n);
+    }
+
+    phases.push_back (Phase ("search.filter"));
+    for (int i = 0; i < lookups; i++) {
+	int n	= rand () % users;
+	measure (true, read_filter, agent, &n);
+    }
+
+    phases.push_back (Phase ("search.subtree"));
+    for (int i = 0; i < repeat; i++)
+	measure (true, read_subtree, agent, NULL);
+
+    phases.push_back (Phase ("write.add"));
+    measure (true, add_container, agent, NULL);
+    for (int i = 0; i < writes; i++)
+	measure (true, add_entry, agent, &i);
+
+    phases.push_back (Phase ("write.modify"));
+    for (int i = 0; i < writes; i++)
+	measure (true, modify_entry, agent, &i);
+
+    phases.push_back (Phase ("write.move_subtree"));
+    measure (true, move_subtree, agent, NULL);
+
+    phases.push_back (Phase ("write.delete_subtree"));
+    measure (true, delete_subtree, agent, NULL);
+
+    report ();
+    return 0;
+}
@@ -0,0 +1,212 @@
+/* ------------------------------------------------------------------------------
+ * Copyright (c) 2026 SUSE LLC. All Rights Reserved.
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, contact SUSE LLC.
+ * ------------------------------------------------------------------------------
+ */
+
+/* LdapCache.cc
+ *
+ * Cache of search results for Ldap agent
+ *
+ * $Id$
+ */
+
+#include "LdapCache.h"
+#include <ctype.h>
+
+LdapCache::LdapCache ()
+{
+    max_size	= 0;
+    ttl		= 0;
+    hits	= 0;
+    misses	= 0;
+}
+
+/**
+ * set the limits, drop the current content and reset the counters
+ */
+void LdapCache::configure (int size, int seconds)
+{
+    max_size	= size > 0 ? size : 0;
+    ttl		= seconds;
+    hits	= 0;
+    misses	= 0;
+    items.clear ();
+}
+
+/**
+ * find the valid item
+ */
+YCPValue LdapCache::lookup (const string &base, const string &spec)
+{
+    if (!enabled ())
+	return YCPNull ();
+
+    std::map<string, Item>::iterator i = items.find (normalize_dn (base) + "\n" + spec);
+    if (i == items.end ()) {
+	misses++;
+	return YCPNull ();
+    }
+
+    if (time (NULL) - i->second.stored > ttl) {
+	items.erase (i);
+	misses++;
+	return YCPNull ();
+    }
+    hits++;
+    return i->second.value;
+}
+
+/**
+ * store the result of a search
+ */
+void LdapCache::store (const string &base, int scope, const string &spec,
+	const YCPValue &value)
+{
+    if (!enabled ())
+	return;
+
+    Item item;
+    item.base	= normalize_dn (base);
+    item.scope	= scope;
+    item.stored	= time (NULL);
+    item.value	= value;
+
+    string key	= item.base + "\n" + spec;
+    if (items.find (key) == items.end () && items.size () >= max_size)
+	evict ();
+    items[key]	= item;
+}
+
+/**
+ * remove expired items; if the cache is still full, remove the oldest one
+ */
+void LdapCache::evict ()
+{
+    time_t now	= time (NULL);
+    std::map<string, Item>::iterator oldest = items.end ();
+    for (std::map<string, Item>::iterator i = items.begin (); i != items.end ();) {
+	if (now - i->second.stored > ttl) {
+	    items.erase (i++);
+	    continue;
+	}
+	if (oldest == items.end () || i->second.stored < oldest->second.stored)
+	    oldest = i;
+	i++;
+    }
+    if (items.size () >= max_size && oldest != items.end ())
+	items.erase (oldest);
+}
+
+/**
+ * drop all items that could be affected by change of given entry
+ */
+void LdapCache::invalidate (const string &dn)
+{
+    if (items.empty ())
+	return;
+
+    string ndn	= normalize_dn (dn);
+    string parent = parent_dn (ndn);
+    for (std::map<string, Item>::iterator i = items.begin (); i != items.end ();) {
+	const Item &item = i->second;
+	bool covered;
+	switch (item.scope) {
+	    case 0:	covered = (ndn == item.base); break;
+	    case 1:	covered = (ndn == item.base || parent == item.base); break;
+	    default:	covered = in_subtree (ndn, item.base);
+	}
+	if (covered || in_subtree (item.base, ndn))
+	    items.erase (i++);
+	else
+	    i++;
+    }
+}
+
+/**
+ * return map with number of hits, misses and stored items
+ */
+YCPMap LdapCache::stats () const
+{
+    YCPMap ret;
+    ret->add (YCPString ("hits"), YCPInteger (hits));
+    ret->add (YCPString ("misses"), YCPInteger (misses));
+    ret->add (YCPString ("size"), YCPInteger (items.size ()));
+    ret->add (YCPString ("enabled"), YCPBoolean (enabled ()));
+    return ret;
+}
+
+/**
+ * drop all items
+ */
+void LdapCache::clear ()
+{
+    items.clear ();
+}
+
+/**
+ * lowercase the DN and remove spaces around separators
+ */
+string LdapCache::normalize_dn (const string &dn)
+{
+    string ret;
+    ret.reserve (dn.size ());
+    for (string::size_type i = 0; i < dn.size (); i++) {
+	char c = dn[i];
+	if (c == '\\' && i + 1 < dn.size ()) {
+	    // escaped character is part of the value
+	    ret += c;
+	    ret += tolower (dn[++i]);
+	    continue;
+	}
+	if (c == ' ') {
+	    string::size_type next = dn.find_first_not_of (' ', i);
+	    bool before_sep = next == string::npos ||
+		dn[next] == ',' || dn[next] == '=' || dn[next] == '+';
+	    bool after_sep = ret.empty () || *ret.rbegin () == ',' ||
+		*ret.rbegin () == '=' || *ret.rbegin () == '+';
+	    if (before_sep || after_sep)
+		continue;
+	}
+	ret += tolower (c);
+    }
+    return ret;
+}
+
+/**
+ * check if the (normalized) dn is the same as base or lies under it
+ */
+bool LdapCache::in_subtree (const string &dn, const string &base)
+{
+    if (base.empty () || dn == base)
+	return true;
+    if (dn.size () <= base.size () + 1)
+	return false;
+    return dn.compare (dn.size () - base.size (), base.size (), base) == 0 &&
+	dn[dn.size () - base.size () - 1] == ',';
+}
+
+/**
+ * return the (normalized) DN of parent entry
+ */
+string LdapCache::parent_dn (const string &dn)
+{
+    for (string::size_type i = 0; i < dn.size (); i++) {
+	if (dn[i] == '\\')
+	    i++;
+	else if (dn[i] == ',')
+	    return dn.substr (i + 1);
+    }
+    return "";
+}
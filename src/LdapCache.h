@@ -0,0 +1,146 @@
+/* ------------------------------------------------------------------------------
+ * Copyright (c) 2026 SUSE LLC. All Rights Reserved.
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, contact SUSE LLC.
+ * ------------------------------------------------------------------------------
+ */
+
+/* LdapCache.h
+ *
+ * Cache of search results for Ldap agent
+ *
+ * $Id$
+ */
+
+#ifndef _LdapCache_h
+#define _LdapCache_h
+
+#include <Y2.h>
+
+#include <map>
+#include <time.h>
+
+/**
+ * @short Size and time limited cache of YCP values of LDAP search results
+ *
+ * Each item remembers the base DN and scope of its search, so writes into
+ * the covered part of the tree can drop it (see invalidate).
+ */
+class LdapCache
+{
+private:
+    struct Item {
+	string	base;
+	int	scope;
+	time_t	stored;
+	YCPValue value;
+
+	Item () : scope (0), stored (0), value (YCPNull ()) {}
+    };
+
+    /**
+     * cached items, indexed by normalized base DN + search specification
+     */
+    std::map<string, Item> items;
+
+    /**
+     * maximal number of items, 0 means the cache is disabled
+     */
+    unsigned max_size;
+
+    /**
+     * number of seconds the item is valid
+     */
+    int ttl;
+
+    /**
+     * counters of successful and unsuccessful lookups
+     */
+    long hits, misses;
+
+    /**
+     * remove expired items; if the cache is still full, remove the oldest one
+     */
+    void evict ();
+
+public:
+    LdapCache ();
+
+    /**
+     * set the limits, drop the current content and reset the counters
+     * @param size maximal number of items (0 disables the cache)
+     * @param seconds time to live of one item
+     */
+    void configure (int size, int seconds);
+
+    /**
+     * true if the cache is switched on
+     */
+    bool enabled () const { return max_size > 0; }
+
+    /**
+     * find the valid item
+     * @param base base DN of the search
+     * @param spec string describing the rest of search parameters
+     * @return cached value or YCPNull if not found
+     */
+    YCPValue lookup (const string &base, const string &spec);
+
+    /**
+     * store the result of a search
+     * @param base base DN of the search
+     * @param scope scope of the search (0:base, 1:one, 2:sub)
+     * @param spec string describing the rest of search parameters
+     * @param value YCP value of the result
+     */
+    void store (const string &base, int scope, const string &spec,
+	const YCPValue &value);
+
+    /**
+     * drop all items that could be affected by change of given entry:
+     * searches covering the entry and searches based inside its subtree
+     */
+    void invalidate (const string &dn);
+
+    /**
+     * drop all items
+     */
+    void clear ();
+
+    /**
+     * number of items stored
+     */
+    int size () const { return items.size (); }
+
+    /**
+     * return map with number of hits, misses and stored items
+     */
+    YCPMap stats () const;
+
+    /**
+     * lowercase the DN and remove spaces around separators
+     */
+    static string normalize_dn (const string &dn);
+
+    /**
+     * check if the (normalized) dn is the same as base or lies under it
+     */
+    static bool in_subtree (const string &dn, const string &base);
+
+    /**
+     * return the (normalized) DN of parent entry
+     */
+    static string parent_dn (const string &dn);
+};
+
+#endif /* _LdapCache_h */
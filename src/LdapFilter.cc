@@ -0,0 +1,343 @@
+/* ------------------------------------------------------------------------------
+ * Copyright (c) 2026 SUSE LLC. All Rights Reserved.
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, contact SUSE LLC.
+ * ------------------------------------------------------------------------------
+ */
+/* LdapFilter.cc
+ *
+ * Evaluation of LDAP search filters (RFC 4515) on entries held in memory
+ *
+ * $Id$
+ */
+
+#include "LdapFilter.h"
+
+#include <LDAPEntry.h>
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <strings.h>
+
+LdapFilter::LdapFilter ()
+{
+    root.type	= Node::PRESENT;
+    root.attr	= "objectclass";
+}
+
+string LdapFilter::lower (const string &s)
+{
+    string ret	= s;
+    for (string::iterator i = ret.begin (); i != ret.end (); i++)
+	*i	= tolower (*i);
+    return ret;
+}
+
+bool LdapFilter::parse (const string &filter)
+{
+    string f	= filter;
+    // surrounding spaces and missing parentheses are tolerated
+    string::size_type start	= f.find_first_not_of (" ");
+    string::size_type end	= f.find_last_not_of (" ");
+    if (start == string::npos)
+	f	= "(objectClass=*)";
+    else
+	f	= f.substr (start, end - start + 1);
+    if (f[0] != '(')
+	f	= "(" + f + ")";
+
+    string::size_type pos	= 0;
+    Node node;
+    if (!parse_filter (f, pos, node) || pos != f.size ())
+	return false;
+    root	= node;
+    return true;
+}
+
+/**
+ * filter = "(" ( "&" filterlist / "|" filterlist / "!" filter / item ) ")"
+ */
+bool LdapFilter::parse_filter (const string &s, string::size_type &pos, Node &node)
+{
+    if (pos >= s.size () || s[pos] != '(')
+	return false;
+    pos++;
+    if (pos >= s.size ())
+	return false;
+
+    char c	= s[pos];
+    if (c == '&' || c == '|' || c == '!') {
+	node.type	= c == '&' ? Node::AND : (c == '|' ? Node::OR : Node::NOT);
+	pos++;
+	while (pos < s.size () && s[pos] == '(') {
+	    Node child;
+	    if (!parse_filter (s, pos, child))
+		return false;
+	    node.children.push_back (child);
+	}
+	if (node.type == Node::NOT && node.children.size () != 1)
+	    return false;
+    }
+    else {
+	string::size_type end	= s.find (')', pos);
+	if (end == string::npos)
+	    return false;
+	if (!parse_item (s.substr (pos, end - pos), node))
+	    return false;
+	pos	= end;
+    }
+    if (pos >= s.size () || s[pos] != ')')
+	return false;
+    pos++;
+    return true;
+}
+
+/**
+ * item = attr ( "=" / "~=" / ">=" / "<=" ) value, "attr=*" or
+ * substring "attr=[initial]*any*...[final]"
+ */
+bool LdapFilter::parse_item (const string &item, Node &node)
+{
+    string::size_type eq	= item.find ('=');
+    if (eq == string::npos || eq == 0)
+	return false;
+
+    string attr		= item.substr (0, eq);
+    string value	= item.substr (eq + 1);
+    char op		= attr[attr.size () - 1];
+    if (op == '~' || op == '>' || op == '<')
+	attr	= attr.substr (0, attr.size () - 1);
+    else
+	op	= '=';
+
+    if (attr.find (':') != string::npos) {
+	// extensible match is not supported
+	node.type	= Node::UNDEFINED;
+	return true;
+    }
+    if (attr.empty ())
+	return false;
+    node.attr	= lower (attr);
+
+    if (op == '=' && value == "*") {
+	node.type	= Node::PRESENT;
+	return true;
+    }
+    if (op == '=' && value.find ('*') != string::npos) {
+	node.type	= Node::SUBSTRING;
+	string::size_type start	= 0;
+	while (true) {
+	    string::size_type star	= value.find ('*', start);
+	    string part;
+	    if (!unescape (value.substr (start, star == string::npos ?
+		string::npos : star - start), part))
+		return false;
+	    node.parts.push_back (lower (part));
+	    if (star == string::npos)
+		break;
+	    start	= star + 1;
+	}
+	return true;
+    }
+    node.type	= op == '>' ? Node::GREATER : (op == '<' ? Node::LESS : Node::EQUAL);
+    if (!unescape (value, node.value))
+	return false;
+    node.value	= lower (node.value);
+    return true;
+}
+
+/**
+ * replace \XX escapes by the characters
+ */
+bool LdapFilter::unescape (const string &s, string &value)
+{
+    value	= "";
+    for (string::size_type i = 0; i < s.size (); i++) {
+	if (s[i] == '\\') {
+	    if (i + 2 >= s.size ())
+		return false;
+	    if (!isxdigit (s[i+1]) || !isxdigit (s[i+2]))
+		return false;
+	    value	+= (char) strtol (s.substr (i + 1, 2).c_str (), NULL, 16);
+	    i	+= 2;
+	}
+	else if (s[i] == '(')
+	    return false;
+	else
+	    value	+= s[i];
+    }
+    return true;
+}
+
+/**
+ * attribute values of LDAPEntry
+ */
+class EntryObject : public LdapFilter::Object
+{
+public:
+    EntryObject (const LDAPEntry *e) : entry (e) {}
+
+    bool values (const string &attr, std::vector<string> &values) const
+    {
+	const LDAPAttributeList *al	= entry->getAttributes ();
+	for (LDAPAttributeList::const_iterator i = al->begin (); i != al->end (); i++) {
+	    if (strcasecmp (i->getName ().c_str (), attr.c_str ()) == 0) {
+		const StringList &sl	= i->getValues ();
+		values.insert (values.end (), sl.begin (), sl.end ());
+		return true;
+	    }
+	}
+	return false;
+    }
+
+private:
+    const LDAPEntry *entry;
+};
+
+/**
+ * parse the whole string as integer
+ */
+static bool to_number (const string &s, long long &n)
+{
+    if (s.empty ())
+	return false;
+    char *end;
+    errno	= 0;
+    n	= strtoll (s.c_str (), &end, 10);
+    return *end == '\0' && errno == 0;
+}
+
+bool LdapFilter::match_value (const Node &node, const string &value)
+{
+    string v	= lower (value);
+    switch (node.type) {
+	case Node::EQUAL:
+	    return v == node.value;
+	case Node::GREATER:
+	case Node::LESS: {
+	    long long a, b;
+	    int cmp;
+	    if (to_number (v, a) && to_number (node.value, b))
+		cmp	= a < b ? -1 : (a > b ? 1 : 0);
+	    else
+		cmp	= v.compare (node.value);
+	    return node.type == Node::GREATER ? cmp >= 0 : cmp <= 0;
+	}
+	case Node::SUBSTRING: {
+	    const string &initial	= node.parts.front ();
+	    const string &final	= node.parts.back ();
+	    if (v.size () < initial.size () + final.size ())
+		return false;
+	    if (v.compare (0, initial.size (), initial) != 0)
+		return false;
+	    if (v.compare (v.size () - final.size (), final.size (), final) != 0)
+		return false;
+	    string::size_type pos	= initial.size ();
+	    string::size_type limit	= v.size () - final.size ();
+	    for (unsigned i = 1; i + 1 < node.parts.size (); i++) {
+		pos	= v.find (node.parts[i], pos);
+		if (pos == string::npos || pos + node.parts[i].size () > limit)
+		    return false;
+		pos	+= node.parts[i].size ();
+	    }
+	    return true;
+	}
+	default:
+	    return false;
+    }
+}
+
+/**
+ * evaluate the node with three-valued logic of RFC 4511: Undefined
+ * stays Undefined through NOT, AND is FALSE when any part is FALSE and
+ * OR is TRUE when any part is TRUE
+ */
+LdapFilter::Result LdapFilter::match_node (const Node &node, const Object &object)
+{
+    Result ret;
+    switch (node.type) {
+	case Node::AND:
+	    ret	= MATCH_TRUE;
+	    for (unsigned i = 0; i < node.children.size () && ret != MATCH_FALSE; i++) {
+		Result r	= match_node (node.children[i], object);
+		if (r != MATCH_TRUE)
+		    ret	= r;
+	    }
+	    return ret;
+	case Node::OR:
+	    ret	= MATCH_FALSE;
+	    for (unsigned i = 0; i < node.children.size () && ret != MATCH_TRUE; i++) {
+		Result r	= match_node (node.children[i], object);
+		if (r != MATCH_FALSE)
+		    ret	= r;
+	    }
+	    return ret;
+	case Node::NOT:
+	    ret	= match_node (node.children[0], object);
+	    if (ret == MATCH_UNDEFINED)
+		return ret;
+	    return ret == MATCH_TRUE ? MATCH_FALSE : MATCH_TRUE;
+	case Node::UNDEFINED:
+	    return MATCH_UNDEFINED;
+	default:
+	    break;
+    }
+
+    // attribute absent from the entry does not match (like on the
+    // server for known attribute types)
+    std::vector<string> values;
+    if (!object.values (node.attr, values))
+	return MATCH_FALSE;
+    if (node.type == Node::PRESENT)
+	return MATCH_TRUE;
+    for (unsigned i = 0; i < values.size (); i++)
+	if (match_value (node, values[i]))
+	    return MATCH_TRUE;
+    return MATCH_FALSE;
+}
+
+bool LdapFilter::match (const LDAPEntry *entry) const
+{
+    return match_node (root, EntryObject (entry)) == MATCH_TRUE;
+}
+
+bool LdapFilter::match (const Object &object) const
+{
+    return match_node (root, object) == MATCH_TRUE;
+}
+
+bool LdapFilter::required_equality (const std::vector<string> &indexed,
+    string &attr, string &value) const
+{
+    std::vector<const Node *> nodes;
+    if (root.type == Node::AND) {
+	for (unsigned i = 0; i < root.children.size (); i++)
+	    nodes.push_back (&root.children[i]);
+    }
+    else
+	nodes.push_back (&root);
+
+    for (unsigned i = 0; i < nodes.size (); i++) {
+	if (nodes[i]->type != Node::EQUAL)
+	    continue;
+	for (unsigned j = 0; j < indexed.size (); j++) {
+	    if (nodes[i]->attr == indexed[j]) {
+		attr	= nodes[i]->attr;
+		value	= nodes[i]->value;
+		return true;
+	    }
+	}
+    }
+    return false;
+}
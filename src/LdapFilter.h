@@ -0,0 +1,121 @@
+/* ------------------------------------------------------------------------------
+ * Copyright (c) 2026 SUSE LLC. All Rights Reserved.
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, contact SUSE LLC.
+ * ------------------------------------------------------------------------------
+ */
+/* LdapFilter.h
+ *
+ * Evaluation of LDAP search filters (RFC 4515) on entries held in memory
+ *
+ * $Id$
+ */
+
+#ifndef _LdapFilter_h
+#define _LdapFilter_h
+
+#include <Y2.h>
+
+#include <vector>
+
+class LDAPEntry;
+class LDAPAttribute;
+
+/**
+ * @short Parsed LDAP search filter, matched against LDAPEntry objects
+ * (or any other objects providing attribute values)
+ *
+ * All values are compared case-insensitively; ordering (<=, >=) is
+ * numeric when both values are integers. Approximate match is handled
+ * as equality. Any comparison with attribute absent from the object is
+ * FALSE. Extensible match is Undefined, which is kept through NOT and
+ * does not match at the top level (RFC 4511).
+ */
+class LdapFilter
+{
+public:
+    /**
+     * @short Object whose attributes are matched by the filter
+     */
+    class Object
+    {
+    public:
+	virtual ~Object () {}
+
+	/**
+	 * add values of the attribute (lower-case name) to the list
+	 * @return false if the object has no such attribute
+	 */
+	virtual bool values (const string &attr,
+	    std::vector<string> &values) const = 0;
+    };
+
+    LdapFilter ();
+
+    /**
+     * parse the filter; enclosing parentheses are optional
+     * (e.g. "objectClass=*")
+     * @return false on syntax error
+     */
+    bool parse (const string &filter);
+
+    /**
+     * check if the entry matches the filter
+     */
+    bool match (const LDAPEntry *entry) const;
+
+    /**
+     * check if the object matches the filter
+     */
+    bool match (const Object &object) const;
+
+    /**
+     * find the equality assertion the matching entries must satisfy
+     * (the filter itself or a part of top-level AND), so candidates
+     * can be taken from the index of the attribute
+     * @return false if there is no such assertion
+     */
+    bool required_equality (const std::vector<string> &indexed,
+	string &attr, string &value) const;
+
+    /**
+     * lower case of the string (ASCII)
+     */
+    static string lower (const string &s);
+
+private:
+    struct Node
+    {
+	enum Type { AND, OR, NOT, EQUAL, GREATER, LESS, PRESENT, SUBSTRING,
+	    UNDEFINED };
+	Type	type;
+	// lower-case attribute name and value
+	string	attr;
+	string	value;
+	// substring parts: initial (may be empty), any..., final (may be empty)
+	std::vector<string> parts;
+	std::vector<Node> children;
+    };
+
+    Node root;
+
+    enum Result { MATCH_FALSE, MATCH_TRUE, MATCH_UNDEFINED };
+
+    bool parse_filter (const string &s, string::size_type &pos, Node &node);
+    bool parse_item (const string &item, Node &node);
+    static bool unescape (const string &s, string &value);
+    static Result match_node (const Node &node, const Object &object);
+    static bool match_value (const Node &node, const string &value);
+};
+
+#endif /* _LdapFilter_h */
@@ -0,0 +1,108 @@
+/* ------------------------------------------------------------------------------
+ * Copyright (c) 2026 SUSE LLC. All Rights Reserved.
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, contact SUSE LLC.
+ * ------------------------------------------------------------------------------
+ */
+/* LdapFilterTest.cc
+ *
+ * Tests of LDAP filter evaluation (run by make check)
+ *
+ * $Id$
+ */
+
+#include "LdapFilter.h"
+
+#include <map>
+#include <stdio.h>
+
+/**
+ * object with attribute values given in the test
+ */
+class TestObject : public LdapFilter::Object
+{
+public:
+    TestObject &add (const string &attr, const string &value)
+    {
+	attrs[LdapFilter::lower (attr)].push_back (value);
+	return *this;
+    }
+
+    bool values (const string &attr, std::vector<string> &values) const
+    {
+	std::map<string, std::vector<string> >::const_iterator i =
+	    attrs.find (attr);
+	if (i == attrs.end ())
+	    return false;
+	values.insert (values.end (), i->second.begin (), i->second.end ());
+	return true;
+    }
+
+private:
+    std::map<string, std::vector<string> > attrs;
+};
+
+static int failures	= 0;
+
+static void check (const TestObject &object, const string &filter, bool expected)
+{
+    LdapFilter f;
+    if (!f.parse (filter)) {
+	printf ("FAIL %s: not parsed\n", filter.c_str ());
+	failures++;
+	return;
+    }
+    bool matched	= f.match (object);
+    if (matched != expected) {
+	printf ("FAIL %s: %s expected\n", filter.c_str (),
+	    expected ? "match" : "no match");
+	failures++;
+    }
+}
+
+int main ()
+{
+    TestObject user;
+    user.add ("objectClass", "posixAccount").add ("objectClass", "top")
+	.add ("uid", "jdoe").add ("uidNumber", "1000")
+	.add ("loginShell", "/bin/bash");
+
+    check (user, "(uid=JDOE)", true);
+    check (user, "(&(loginShell=/bin/bash)(uidNumber>=999))", true);
+    check (user, "(uidNumber<=999)", false);
+    check (user, "(uid=j*e)", true);
+    check (user, "(!(uid=ann))", true);
+    check (user, "(!(mail=*))", true);
+
+    // absent attribute is FALSE, also under NOT
+    check (user, "(!(mail=x))", true);
+    check (user, "(!(!(mail=x)))", false);
+    check (user, "(&(uid=jdoe)(!(mail=x)))", true);
+    check (user, "(|(uid=jdoe)(!(mail=x)))", true);
+    check (user, "(!(&(uid=ann)(mail=x)))", true);
+    check (user, "(!(|(uid=ann)(mail=x)))", true);
+    check (user, "(!(mail>=1))", true);
+
+    // Undefined stays Undefined through NOT (RFC 4511)
+    check (user, "(!(uid:caseExactMatch:=jdoe))", false);
+    check (user, "(!(!(uid:caseExactMatch:=jdoe)))", false);
+    check (user, "(&(uid=jdoe)(!(uid:caseExactMatch:=x)))", false);
+    // ... but OR with TRUE and AND with FALSE decide
+    check (user, "(|(uid=jdoe)(!(uid:caseExactMatch:=x)))", true);
+    check (user, "(!(&(uid=ann)(uid:caseExactMatch:=x)))", true);
+    check (user, "(!(|(uid=ann)(uid:caseExactMatch:=x)))", false);
+
+    if (failures)
+	printf ("%i test(s) failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,164 @@
+/* ------------------------------------------------------------------------------
+ * Copyright (c) 2026 SUSE LLC. All Rights Reserved.
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, contact SUSE LLC.
+ * ------------------------------------------------------------------------------
+ */
+/* LdapGroupGraph.cc
+ *
+ * Effective members of nested groups
+ *
+ * $Id$
+ */
+
+#include "LdapGroupGraph.h"
+#include "LdapCache.h"
+
+LdapGroupGraph::LdapGroupGraph ()
+{
+    counter	= 0;
+    cycles	= 0;
+}
+
+LdapGroupGraph::~LdapGroupGraph ()
+{
+    for (unsigned i = 0; i < closure.size (); i++)
+	delete closure[i];
+}
+
+unsigned LdapGroupGraph::node (const string &dn)
+{
+    string ndn	= LdapCache::normalize_dn (dn);
+    std::map<string, unsigned>::iterator i = nodes.find (ndn);
+    if (i != nodes.end ())
+	return i->second;
+    unsigned n	= dns.size ();
+    dns.push_back (dn);
+    node_groups.push_back (-1);
+    nodes[ndn]	= n;
+    return n;
+}
+
+void LdapGroupGraph::add_group (const string &dn)
+{
+    unsigned n	= node (dn);
+    if (node_groups[n] != -1)
+	return;
+    node_groups[n]	= group_nodes.size ();
+    group_nodes.push_back (n);
+    direct.push_back (std::vector<unsigned> ());
+}
+
+void LdapGroupGraph::add_member (const string &group_dn, const string &member_dn)
+{
+    int group	= node_groups[node (group_dn)];
+    if (group != -1)
+	direct[group].push_back (node (member_dn));
+}
+
+int LdapGroupGraph::resolve ()
+{
+    unsigned n	= group_nodes.size ();
+    component.assign (n, -1);
+    index.assign (n, -1);
+    low.assign (n, 0);
+    on_stack.assign (n, false);
+    stack.clear ();
+    counter	= 0;
+    cycles	= 0;
+    for (unsigned g = 0; g < n; g++) {
+	if (index[g] == -1)
+	    visit (g);
+    }
+    // state of the search is not needed any more
+    index.clear ();
+    low.clear ();
+    on_stack.clear ();
+    return cycles;
+}
+
+/**
+ * Tarjan's algorithm: components are finished in reverse topological
+ * order, so the closures of nested groups are ready when a component
+ * is finished
+ */
+void LdapGroupGraph::visit (unsigned group)
+{
+    index[group]	= low[group]	= counter++;
+    stack.push_back (group);
+    on_stack[group]	= true;
+
+    const std::vector<unsigned> &members	= direct[group];
+    for (unsigned i = 0; i < members.size (); i++) {
+	int nested	= node_groups[members[i]];
+	if (nested == -1)
+	    continue;
+	if (index[nested] == -1) {
+	    visit (nested);
+	    low[group]	= std::min (low[group], low[nested]);
+	}
+	else if (on_stack[nested])
+	    low[group]	= std::min (low[group], index[nested]);
+    }
+    if (low[group] != index[group])
+	return;
+
+    // group is the root of component: take its groups from the stack
+    std::vector<unsigned> groups;
+    unsigned g;
+    do {
+	g	= stack.back ();
+	stack.pop_back ();
+	on_stack[g]	= false;
+	component[g]	= closure.size ();
+	groups.push_back (g);
+    } while (g != group);
+
+    std::set<unsigned> *members_of	= new std::set<unsigned>;
+    bool cycle	= groups.size () > 1;
+    for (unsigned i = 0; i < groups.size (); i++) {
+	const std::vector<unsigned> &d	= direct[groups[i]];
+	for (unsigned j = 0; j < d.size (); j++) {
+	    int nested	= node_groups[d[j]];
+	    if (nested == -1)
+		members_of->insert (d[j]);
+	    else if (component[nested] == component[g])
+		cycle	= true;
+	    else
+		members_of->insert (closure[component[nested]]->begin (),
+		    closure[component[nested]]->end ());
+	}
+    }
+    if (cycle) {
+	cycles++;
+	y2warning ("groups in membership cycle: %s%s", dns[group_nodes[group]].c_str(),
+	    groups.size () > 1 ? ", ..." : "");
+    }
+    closure.push_back (members_of);
+}
+
+std::vector<string> LdapGroupGraph::members (const string &group_dn) const
+{
+    std::vector<string> ret;
+    std::map<string, unsigned>::const_iterator n =
+	nodes.find (LdapCache::normalize_dn (group_dn));
+    if (n == nodes.end () || node_groups[n->second] == -1)
+	return ret;
+    int c	= component[node_groups[n->second]];
+    if (c == -1)
+	return ret;
+    const std::set<unsigned> *m	= closure[c];
+    for (std::set<unsigned>::const_iterator i = m->begin (); i != m->end (); i++)
+	ret.push_back (dns[*i]);
+    return ret;
+}
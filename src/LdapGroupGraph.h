@@ -0,0 +1,100 @@
+/* ------------------------------------------------------------------------------
+ * Copyright (c) 2026 SUSE LLC. All Rights Reserved.
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, contact SUSE LLC.
+ * ------------------------------------------------------------------------------
+ */
+/* LdapGroupGraph.h
+ *
+ * Effective members of nested groups
+ *
+ * $Id$
+ */
+
+#ifndef _LdapGroupGraph_h
+#define _LdapGroupGraph_h
+
+#include <Y2.h>
+
+#include <map>
+#include <set>
+#include <vector>
+
+/**
+ * @short Graph of group membership and its transitive closure
+ *
+ * Groups and members are identified by DN (compared normalized); member
+ * which is a group itself brings all its members. Groups in a cycle have
+ * the same effective members; the closure is computed once for each set
+ * of such groups (strongly connected component).
+ */
+class LdapGroupGraph
+{
+public:
+    LdapGroupGraph ();
+    ~LdapGroupGraph ();
+
+    /**
+     * add the group (before its members)
+     */
+    void add_group (const string &dn);
+
+    /**
+     * add direct member of the group
+     */
+    void add_member (const string &group_dn, const string &member_dn);
+
+    /**
+     * compute the effective members of all groups
+     * @return number of membership cycles found
+     */
+    int resolve ();
+
+    /**
+     * effective members (DNs as they were added) of the group, without
+     * the nested groups themselves
+     */
+    std::vector<string> members (const string &group_dn) const;
+
+private:
+    // DN as added and normalized DN -> index of node
+    std::vector<string> dns;
+    std::map<string, unsigned> nodes;
+
+    // node of each group, groups of nodes (-1 if the node is not a group)
+    std::vector<unsigned> group_nodes;
+    std::vector<int> node_groups;
+
+    // direct members of each group (nodes)
+    std::vector<std::vector<unsigned> > direct;
+
+    // component of each group and effective members of each component
+    std::vector<int> component;
+    std::vector<std::set<unsigned>*> closure;
+
+    // state of Tarjan's algorithm
+    std::vector<int> index;
+    std::vector<int> low;
+    std::vector<bool> on_stack;
+    std::vector<unsigned> stack;
+    int counter;
+    int cycles;
+
+    unsigned node (const string &dn);
+    void visit (unsigned group);
+
+    LdapGroupGraph (const LdapGroupGraph&);
+    LdapGroupGraph& operator= (const LdapGroupGraph&);
+};
+
+#endif /* _LdapGroupGraph_h */
@@ -0,0 +1,90 @@
+/* ------------------------------------------------------------------------------
+ * Copyright (c) 2026 SUSE LLC. All Rights Reserved.
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, contact SUSE LLC.
+ * ------------------------------------------------------------------------------
+ */
+/* LdapIdSet.cc
+ *
+ * Set of allocated UID's or GID's, for finding free ones
+ *
+ * $Id$
+ */
+
+#include "LdapIdSet.h"
+
+void LdapIdSet::clear ()
+{
+    intervals.clear ();
+}
+
+void LdapIdSet::add (int id)
+{
+    std::map<int, int>::iterator next	= intervals.upper_bound (id);
+    if (next != intervals.begin ()) {
+	std::map<int, int>::iterator prev	= next;
+	prev--;
+	if (prev->second >= id)
+	    return;
+	if ((long long) prev->second + 1 == id) {
+	    // join with the previous and maybe also the following interval
+	    if (next != intervals.end () && (long long) id + 1 == next->first) {
+		prev->second	= next->second;
+		intervals.erase (next);
+	    }
+	    else
+		prev->second	= id;
+	    return;
+	}
+    }
+    if (next != intervals.end () && (long long) id + 1 == next->first) {
+	int last	= next->second;
+	intervals.erase (next);
+	intervals[id]	= last;
+	return;
+    }
+    intervals[id]	= id;
+}
+
+bool LdapIdSet::contains (int id) const
+{
+    std::map<int, int>::const_iterator i	= intervals.upper_bound (id);
+    if (i == intervals.begin ())
+	return false;
+    i--;
+    return i->second >= id;
+}
+
+std::vector<int> LdapIdSet::free (int min, int max, int count) const
+{
+    std::vector<int> ret;
+    long long id	= min;
+    std::map<int, int>::const_iterator i	= intervals.upper_bound (min);
+    if (i != intervals.begin ()) {
+	std::map<int, int>::const_iterator prev	= i;
+	prev--;
+	if (prev->second >= id)
+	    id	= (long long) prev->second + 1;
+    }
+    while (id <= max && (int) ret.size () < count) {
+	// free ID's are up to the start of next interval
+	long long used	= i == intervals.end () ? (long long) max + 1 : i->first;
+	for (; id < used && id <= max && (int) ret.size () < count; id++)
+	    ret.push_back (id);
+	if (i == intervals.end ())
+	    break;
+	id	= (long long) i->second + 1;
+	i++;
+    }
+    return ret;
+}
@@ -0,0 +1,70 @@
+/* ------------------------------------------------------------------------------
+ * Copyright (c) 2026 SUSE LLC. All Rights Reserved.
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, contact SUSE LLC.
+ * ------------------------------------------------------------------------------
+ */
+/* LdapIdSet.h
+ *
+ * Set of allocated UID's or GID's, for finding free ones
+ *
+ * $Id$
+ */
+
+#ifndef _LdapIdSet_h
+#define _LdapIdSet_h
+
+#include <map>
+#include <vector>
+
+/**
+ * @short Allocated numbers kept as intervals
+ *
+ * Allocated ID's are mostly continuous, so even large number of them
+ * takes few intervals and free ID's are found without going through
+ * all allocated ones.
+ */
+class LdapIdSet
+{
+public:
+    /**
+     * forget all ID's
+     */
+    void clear ();
+
+    /**
+     * mark the ID as allocated
+     */
+    void add (int id);
+
+    /**
+     * check if the ID is allocated
+     */
+    bool contains (int id) const;
+
+    /**
+     * find free ID's
+     * @param min lowest ID to return
+     * @param max highest ID to return
+     * @param count number of ID's wanted
+     * @return lowest free ID's from the range (less than count if there
+     * is not enough of them)
+     */
+    std::vector<int> free (int min, int max, int count) const;
+
+private:
+    // first ID of interval -> last ID of interval
+    std::map<int, int> intervals;
+};
+
+#endif /* _LdapIdSet_h */
@@ -0,0 +1,763 @@
+/* ------------------------------------------------------------------------------
+ * Copyright (c) 2026 SUSE LLC. All Rights Reserved.
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, contact SUSE LLC.
+ * ------------------------------------------------------------------------------
+ */
+/* LdapLdif.cc
+ *
+ * Read-only LDAP data taken from LDIF file (offline backend)
+ *
+ * $Id$
+ */
+
+#include "LdapLdif.h"
+#include "LdapCache.h"
+#include "LdapFilter.h"
+
+#include <LDAPException.h>
+#include <LDAPAttributeList.h>
+#include <LDAPReferralException.h>
+#include <LDAPResult.h>
+#include <LDAPSearchReference.h>
+#include <LDAPSearchResult.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <set>
+
+LdapResults::LdapResults (LDAPSearchResults *results)
+{
+    this->results	= results;
+    queue		= NULL;
+}
+
+LdapResults::LdapResults (LDAPMessageQueue *queue)
+{
+    results		= NULL;
+    this->queue		= queue;
+}
+
+LdapResults::~LdapResults ()
+{
+    delete results;
+    delete queue;
+    for (unsigned i = 0; i < entries.size (); i++)
+	delete entries[i];
+}
+
+void LdapResults::add (LDAPEntry *entry)
+{
+    entries.push_back (entry);
+}
+
+LDAPEntry *LdapResults::getNext ()
+{
+    if (results)
+	return results->getNext ();
+    while (queue) {
+	LDAPMsg *msg	= NULL;
+	try {
+	    msg	= queue->getNext ();
+	}
+	catch (LDAPException e) {
+	    // e.g. connection lost, there will be no more messages
+	    delete queue;
+	    queue	= NULL;
+	    throw;
+	}
+	if (msg == NULL)
+	    break;
+	switch (msg->getMessageType ()) {
+	    case LDAPMsg::SEARCH_ENTRY: {
+		LDAPEntry *entry =
+		    new LDAPEntry (*((LDAPSearchResult*) msg)->getEntry ());
+		delete msg;
+		return entry;
+	    }
+	    case LDAPMsg::SEARCH_REFERENCE: {
+		LDAPUrlList urls = ((LDAPSearchReference*) msg)->getUrls ();
+		delete msg;
+		throw LDAPReferralException (urls);
+	    }
+	    case LDAPMsg::SEARCH_DONE: {
+		int code	= ((LDAPResult*) msg)->getResultCode ();
+		delete msg;
+		// no more messages
+		delete queue;
+		queue	= NULL;
+		if (code != LDAPResult::SUCCESS)
+		    throw LDAPException (code, ldap_err2string (code));
+		return NULL;
+	    }
+	    default:
+		delete msg;
+	}
+    }
+    if (entries.empty ())
+	return NULL;
+    LDAPEntry *entry	= entries.front ();
+    entries.pop_front ();
+    return entry;
+}
+
+LdifReader::LdifReader ()
+{
+    file	= NULL;
+    buffer	= NULL;
+    buffer_size	= 0;
+    lineno	= 0;
+    record_line	= 0;
+}
+
+LdifReader::~LdifReader ()
+{
+    if (file)
+	fclose (file);
+    free (buffer);
+}
+
+bool LdifReader::open (const string &file)
+{
+    this->file	= fopen (file.c_str (), "r");
+    if (!this->file) {
+	last_error	= file + ": " + strerror (errno);
+	y2error ("cannot open %s", last_error.c_str());
+	return false;
+    }
+    lineno	= 0;
+    return true;
+}
+
+bool LdifReader::next (string &dn, LdifValues &values)
+{
+    while (file) {
+	// read lines up to the empty one, join folded lines
+	std::vector<string> lines;
+	ssize_t length;
+	while ((length = getline (&buffer, &buffer_size, file)) != -1) {
+	    lineno++;
+	    while (length > 0 &&
+		(buffer[length - 1] == '\n' || buffer[length - 1] == '\r'))
+		length--;
+	    if (length == 0) {
+		if (lines.empty ())
+		    continue;
+		break;
+	    }
+	    if (buffer[0] == ' ' && !lines.empty ())
+		lines.back ().append (buffer + 1, length - 1);
+	    else {
+		if (lines.empty ())
+		    record_line	= lineno;
+		lines.push_back (string (buffer, length));
+	    }
+	}
+	if (lines.empty ())
+	    return false;
+
+	dn	= "";
+	values.clear ();
+	bad_value	= "";
+	// skip records with comments or version only
+	if (parse (lines, dn, values, bad_value) || !values.empty () ||
+	    bad_value != "")
+	    return true;
+    }
+    return false;
+}
+
+bool LdifReader::parse (const std::vector<string> &lines, string &dn,
+    LdifValues &values, string &bad_value)
+{
+    bool have_dn	= false;
+    for (unsigned i = 0; i < lines.size (); i++) {
+	const string &line	= lines[i];
+	if (line.empty () || line[0] == '#')
+	    continue;
+	// separator of modifications
+	if (line == "-") {
+	    values.push_back (std::make_pair (line, string ()));
+	    continue;
+	}
+	string::size_type colon	= line.find (':');
+	if (colon == string::npos || colon == 0) {
+	    y2warning ("wrong LDIF line '%s'", line.c_str());
+	    continue;
+	}
+	string name	= line.substr (0, colon);
+	string::size_type pos	= colon + 1;
+	bool base64	= false;
+	bool url	= false;
+	if (pos < line.size () && line[pos] == ':') {
+	    base64	= true;
+	    pos++;
+	}
+	else if (pos < line.size () && line[pos] == '<') {
+	    url		= true;
+	    pos++;
+	}
+	string value;
+	pos	= line.find_first_not_of (' ', pos);
+	if (pos != string::npos)
+	    value	= line.substr (pos);
+	string decoded;
+	if (base64) {
+	    if (!decode_base64 (value, decoded)) {
+		y2error ("wrong base64 value of '%s'", name.c_str());
+		if (bad_value == "")
+		    bad_value	= "wrong base64 value of '" + name + "'";
+		continue;
+	    }
+	    value	= decoded;
+	}
+	else if (url) {
+	    if (!read_url (value, decoded)) {
+		y2error ("value of '%s' cannot be read from %s",
+		    name.c_str(), value.c_str());
+		if (bad_value == "")
+		    bad_value	= "value of '" + name + "' cannot be read from "
+			+ value;
+		continue;
+	    }
+	    value	= decoded;
+	}
+
+	if (!have_dn) {
+	    if (strcasecmp (name.c_str (), "version") == 0)
+		continue;
+	    if (strcasecmp (name.c_str (), "dn") != 0) {
+		values.push_back (std::make_pair (name, value));
+		return false;
+	    }
+	    dn		= value;
+	    have_dn	= true;
+	    continue;
+	}
+	values.push_back (std::make_pair (name, value));
+    }
+    return have_dn;
+}
+
+void LdifReader::add_attributes (LDAPAttributeList &attrs,
+    const LdifValues &values, unsigned from)
+{
+    std::vector<LDAPAttribute> list;
+    std::map<string, unsigned> position;
+    for (unsigned i = from; i < values.size (); i++) {
+	string name	= LdapFilter::lower (values[i].first);
+	if (position.find (name) == position.end ()) {
+	    position[name]	= list.size ();
+	    list.push_back (LDAPAttribute (values[i].first));
+	}
+	list[position[name]].addValue (values[i].second);
+    }
+    for (unsigned i = 0; i < list.size (); i++)
+	attrs.addAttribute (list[i]);
+}
+
+bool LdifReader::decode_base64 (const string &in, string &out)
+{
+    static const string chars =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    out	= "";
+    unsigned bits	= 0;
+    int nbits		= 0;
+    for (string::size_type i = 0; i < in.size (); i++) {
+	char c	= in[i];
+	if (c == '=')
+	    break;
+	if (c == ' ' || c == '\t')
+	    continue;
+	string::size_type v	= chars.find (c);
+	if (v == string::npos)
+	    return false;
+	bits	= (bits << 6) | v;
+	nbits	+= 6;
+	if (nbits >= 8) {
+	    nbits	-= 8;
+	    out	+= (char) ((bits >> nbits) & 0xff);
+	}
+    }
+    return true;
+}
+
+/**
+ * read value given as file:// URL
+ */
+bool LdifReader::read_url (const string &url, string &out)
+{
+    if (url.compare (0, 7, "file://") != 0)
+	return false;
+    FILE *f	= fopen (url.substr (7).c_str (), "r");
+    if (!f)
+	return false;
+    out	= "";
+    char buf[4096];
+    size_t n;
+    while ((n = fread (buf, 1, sizeof (buf), f)) > 0)
+	out.append (buf, n);
+    fclose (f);
+    return true;
+}
+
+LdifWriter::LdifWriter ()
+{
+    file	= NULL;
+    count	= 0;
+    written	= 0;
+}
+
+LdifWriter::~LdifWriter ()
+{
+    if (file)
+	fclose (file);
+}
+
+bool LdifWriter::open (const string &file)
+{
+    this->file	= fopen (file.c_str (), "w");
+    if (!this->file) {
+	last_error	= file + ": " + strerror (errno);
+	y2error ("cannot create %s", last_error.c_str());
+	return false;
+    }
+    const char *version	= "version: 1\n";
+    fputs (version, this->file);
+    written	= strlen (version);
+    count	= 0;
+    return true;
+}
+
+void LdifWriter::entry (const char *dn, size_t length)
+{
+    // records are separated by empty line
+    fputc ('\n', file);
+    written++;
+    write_line ("dn", 2, dn, length);
+    count++;
+}
+
+void LdifWriter::value (const char *attr, size_t attr_length,
+    const char *value, size_t length)
+{
+    write_line (attr, attr_length, value, length);
+}
+
+bool LdifWriter::close ()
+{
+    if (!file)
+	return false;
+    bool ok	= !ferror (file);
+    if (fclose (file) != 0)
+	ok	= false;
+    file	= NULL;
+    if (!ok) {
+	last_error	= strerror (errno);
+	y2error ("writing LDIF failed: %s", last_error.c_str());
+    }
+    return ok;
+}
+
+/**
+ * SAFE-STRING of RFC 2849: ASCII without NUL, LF and CR, not starting
+ * with space, colon or less-than; trailing space would be lost, too
+ */
+bool LdifWriter::is_safe (const char *value, size_t length)
+{
+    if (length == 0)
+	return true;
+    if (value[0] == ' ' || value[0] == ':' || value[0] == '<' ||
+	value[length - 1] == ' ')
+	return false;
+    for (size_t i = 0; i < length; i++) {
+	unsigned char c	= value[i];
+	if (c == 0 || c == '\n' || c == '\r' || c > 127)
+	    return false;
+    }
+    return true;
+}
+
+/**
+ * write "attr: value" (or "attr:: base64"), folded at 76 columns
+ */
+void LdifWriter::write_line (const char *attr, size_t attr_length,
+    const char *value, size_t length)
+{
+    static const char chars[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    line.assign (attr, attr_length);
+    if (is_safe (value, length)) {
+	line	+= ": ";
+	line.append (value, length);
+    }
+    else {
+	line	+= ":: ";
+	const unsigned char *v	= (const unsigned char *) value;
+	for (size_t i = 0; i < length; i += 3) {
+	    unsigned n	= v[i] << 16;
+	    if (i + 1 < length)
+		n	|= v[i + 1] << 8;
+	    if (i + 2 < length)
+		n	|= v[i + 2];
+	    line	+= chars[(n >> 18) & 63];
+	    line	+= chars[(n >> 12) & 63];
+	    line	+= i + 1 < length ? chars[(n >> 6) & 63] : '=';
+	    line	+= i + 2 < length ? chars[n & 63] : '=';
+	}
+    }
+
+    size_t pos	= 0;
+    size_t width	= 76;
+    while (pos < line.size ()) {
+	if (pos > 0) {
+	    fputc (' ', file);
+	    written++;
+	}
+	size_t n	= line.size () - pos < width ? line.size () - pos : width;
+	fwrite (line.data () + pos, 1, n, file);
+	fputc ('\n', file);
+	written	+= n + 1;
+	pos	+= n;
+	width	= 75;
+    }
+}
+
+LdifStore::LdifStore ()
+{
+    const char *defaults[] = { "objectclass", "uid", "cn", "uidnumber",
+	"gidnumber", "member", "uniquemember", "memberuid", NULL };
+    for (int i = 0; defaults[i] != NULL; i++)
+	indexed.push_back (defaults[i]);
+}
+
+LdifStore::~LdifStore ()
+{
+    clear_entries ();
+    for (unsigned i = 0; i < maps.size (); i++)
+	munmap (maps[i].first, maps[i].second);
+}
+
+void LdifStore::index (const string &attr)
+{
+    string a	= LdapFilter::lower (attr);
+    for (unsigned i = 0; i < indexed.size (); i++)
+	if (indexed[i] == a)
+	    return;
+    indexed.push_back (a);
+}
+
+bool LdifStore::load (const string &file)
+{
+    int fd	= open (file.c_str (), O_RDONLY);
+    if (fd == -1) {
+	last_error	= file + ": " + strerror (errno);
+	y2error ("cannot open %s", last_error.c_str());
+	return false;
+    }
+    struct stat st;
+    if (fstat (fd, &st) == -1) {
+	last_error	= file + ": " + strerror (errno);
+	y2error ("cannot read %s", last_error.c_str());
+	close (fd);
+	return false;
+    }
+    size_t length	= st.st_size;
+    if (length == 0) {
+	close (fd);
+	return true;
+    }
+    void *addr	= mmap (NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+    if (addr == MAP_FAILED) {
+	last_error	= file + ": " + strerror (errno);
+	y2error ("cannot map %s", last_error.c_str());
+	return false;
+    }
+    maps.push_back (std::make_pair (addr, length));
+
+    // records are separated by empty lines
+    int before		= records.size ();
+    const char *data	= (const char *) addr;
+    const char *end	= data + length;
+    const char *record	= NULL;
+    for (const char *p = data; p < end;) {
+	const char *eol	= (const char *) memchr (p, '\n', end - p);
+	if (!eol)
+	    eol	= end;
+	bool empty	= eol == p || (eol == p + 1 && *p == '\r');
+	if (empty && record) {
+	    add_record (record, p - record);
+	    record	= NULL;
+	}
+	else if (!empty && !record)
+	    record	= p;
+	p	= eol + 1;
+    }
+    if (record)
+	add_record (record, end - record);
+    clear_entries ();
+
+    y2milestone ("%s: %i entries", file.c_str(), (int) records.size () - before);
+    return true;
+}
+
+void LdifStore::add_record (const char *start, size_t length)
+{
+    string dn;
+    LdifValues attrs;
+    if (!parse_record (start, length, dn, attrs))
+	return;
+
+    string ndn	= LdapCache::normalize_dn (dn);
+    if (by_dn.find (ndn) != by_dn.end ()) {
+	y2warning ("duplicate entry '%s' ignored", dn.c_str());
+	return;
+    }
+    unsigned index	= records.size ();
+    Record r;
+    r.start	= start;
+    r.length	= length;
+    r.dn	= ndn;
+    records.push_back (r);
+    by_dn[ndn]	= index;
+    children[LdapCache::parent_dn (ndn)].push_back (index);
+
+    for (LdifValues::const_iterator i = attrs.begin (); i != attrs.end (); i++) {
+	string attr	= LdapFilter::lower (i->first);
+	for (unsigned j = 0; j < indexed.size (); j++) {
+	    if (indexed[j] != attr)
+		continue;
+	    std::vector<unsigned> &list	= values[attr][LdapFilter::lower (i->second)];
+	    if (list.empty () || list.back () != index)
+		list.push_back (index);
+	}
+    }
+}
+
+bool LdifStore::parse_record (const char *start, size_t length,
+    string &dn, LdifValues &attrs)
+{
+    // join folded lines (continuation starts with one space)
+    std::vector<string> lines;
+    const char *end	= start + length;
+    for (const char *p = start; p < end;) {
+	const char *eol	= (const char *) memchr (p, '\n', end - p);
+	if (!eol)
+	    eol	= end;
+	const char *last	= eol;
+	if (last > p && last[-1] == '\r')
+	    last--;
+	if (*p == ' ' && !lines.empty ())
+	    lines.back ().append (p + 1, last - p - 1);
+	else
+	    lines.push_back (string (p, last - p));
+	p	= eol + 1;
+    }
+
+    string bad_value;
+    if (!LdifReader::parse (lines, dn, attrs, bad_value))
+	return false;
+    if (bad_value != "") {
+	y2warning ("entry '%s' ignored: %s", dn.c_str(), bad_value.c_str());
+	return false;
+    }
+    for (LdifValues::const_iterator i = attrs.begin (); i != attrs.end (); i++) {
+	if (strcasecmp (i->first.c_str (), "changetype") == 0) {
+	    y2warning ("change record of '%s' ignored", dn.c_str());
+	    return false;
+	}
+    }
+    return true;
+}
+
+/**
+ * operational attributes are returned only with "+" or by name
+ */
+bool LdifStore::is_operational (const string &attr)
+{
+    const char *operational[] = { "structuralObjectClass", "entryUUID",
+	"entryCSN", "entryDN", "creatorsName", "createTimestamp",
+	"modifiersName", "modifyTimestamp", "contextCSN", "subschemaSubentry",
+	"hasSubordinates", "numSubordinates", "pwdChangedTime",
+	"pwdAccountLockedTime", "pwdFailureTime", "pwdHistory",
+	"pwdGraceUseTime", "pwdReset", "memberOf", "namingContexts",
+	"supportedLDAPVersion", NULL };
+    for (int i = 0; operational[i] != NULL; i++)
+	if (strcasecmp (attr.c_str (), operational[i]) == 0)
+	    return true;
+    return false;
+}
+
+void LdifStore::clear_entries ()
+{
+    for (unsigned i = 0; i < entries.size (); i++)
+	delete entries[i];
+    entries.clear ();
+}
+
+const LDAPEntry *LdifStore::full_entry (unsigned index) const
+{
+    if (entries.size () != records.size ())
+	entries.resize (records.size (), NULL);
+    if (entries[index])
+	return entries[index];
+
+    const Record &r	= records[index];
+    string dn;
+    LdifValues values;
+    parse_record (r.start, r.length, dn, values);
+
+    LDAPAttributeList list;
+    LdifReader::add_attributes (list, values);
+
+    std::map<string, std::vector<unsigned> >::const_iterator c =
+	children.find (r.dn);
+    int num	= c == children.end () ? 0 : c->second.size ();
+    if (!list.getAttributeByName ("hasSubordinates"))
+	list.addAttribute (LDAPAttribute ("hasSubordinates", num > 0 ? "TRUE" : "FALSE"));
+    if (!list.getAttributeByName ("numSubordinates")) {
+	char buf[16];
+	snprintf (buf, sizeof (buf), "%i", num);
+	list.addAttribute (LDAPAttribute ("numSubordinates", buf));
+    }
+    entries[index]	= new LDAPEntry (dn, &list);
+    return entries[index];
+}
+
+std::vector<unsigned> LdifStore::suffixes () const
+{
+    std::vector<unsigned> ret;
+    for (unsigned i = 0; i < records.size (); i++)
+	if (by_dn.find (LdapCache::parent_dn (records[i].dn)) == by_dn.end ())
+	    ret.push_back (i);
+    return ret;
+}
+
+LDAPEntry *LdifStore::root_dse () const
+{
+    StringList contexts;
+    std::vector<unsigned> top	= suffixes ();
+    for (unsigned i = 0; i < top.size (); i++)
+	contexts.add (full_entry (top[i])->getDN ());
+
+    LDAPAttributeList list;
+    list.addAttribute (LDAPAttribute ("objectClass", "top"));
+    if (!contexts.empty ())
+	list.addAttribute (LDAPAttribute ("namingContexts", contexts));
+    list.addAttribute (LDAPAttribute ("supportedLDAPVersion", "3"));
+    return new LDAPEntry ("", &list);
+}
+
+LDAPEntry *LdifStore::select_attributes (const LDAPEntry *entry,
+    const StringList &attrs, bool attrsOnly)
+{
+    bool all_user	= attrs.empty ();
+    bool all_operational= false;
+    std::set<string> named;
+    for (StringList::const_iterator i = attrs.begin (); i != attrs.end (); i++) {
+	if (*i == "*")
+	    all_user	= true;
+	else if (*i == "+")
+	    all_operational	= true;
+	else if (*i != "1.1")
+	    named.insert (LdapFilter::lower (*i));
+    }
+
+    LDAPAttributeList list;
+    const LDAPAttributeList *al	= entry->getAttributes ();
+    for (LDAPAttributeList::const_iterator i = al->begin (); i != al->end (); i++) {
+	string name	= LdapFilter::lower (i->getName ());
+	// attribute options (e.g. ";binary") are not part of the type
+	string type	= name.substr (0, name.find (';'));
+	bool wanted	= named.find (type) != named.end () ||
+	    (is_operational (type) ? all_operational : all_user);
+	if (!wanted)
+	    continue;
+	if (attrsOnly)
+	    list.addAttribute (LDAPAttribute (i->getName ()));
+	else
+	    list.addAttribute (*i);
+    }
+    return new LDAPEntry (entry->getDN (), &list);
+}
+
+LdapResults *LdifStore::search (const string &base, int scope,
+    const string &filter, const StringList &attrs, bool attrsOnly) const
+{
+    LdapFilter f;
+    if (!f.parse (filter))
+	throw LDAPException (LDAP_FILTER_ERROR, "Bad search filter");
+
+    string nbase	= LdapCache::normalize_dn (base);
+    LdapResults *ret;
+    std::vector<unsigned> candidates;
+    if (nbase.empty ()) {
+	// root DSE: naming contexts below it, the whole store as subtree
+	if (scope == LDAPAsynConnection::SEARCH_BASE) {
+	    ret	= new LdapResults ();
+	    LDAPEntry *entry	= root_dse ();
+	    if (f.match (entry))
+		ret->add (select_attributes (entry, attrs, attrsOnly));
+	    delete entry;
+	    return ret;
+	}
+	if (scope == LDAPAsynConnection::SEARCH_ONE)
+	    candidates	= suffixes ();
+    }
+    else if (by_dn.find (nbase) == by_dn.end ())
+	throw LDAPException (LDAP_NO_SUCH_OBJECT, "No such object");
+
+    if (scope == LDAPAsynConnection::SEARCH_BASE) {
+	candidates.push_back (by_dn.find (nbase)->second);
+    }
+    else if (scope == LDAPAsynConnection::SEARCH_ONE) {
+	std::map<string, std::vector<unsigned> >::const_iterator c =
+	    children.find (nbase);
+	if (!nbase.empty () && c != children.end ())
+	    candidates	= c->second;
+    }
+    else {
+	string attr, value;
+	if (f.required_equality (indexed, attr, value)) {
+	    std::map<string, std::map<string, std::vector<unsigned> > >::const_iterator a = values.find (attr);
+	    if (a != values.end ()) {
+		std::map<string, std::vector<unsigned> >::const_iterator v =
+		    a->second.find (value);
+		if (v != a->second.end ())
+		    for (unsigned i = 0; i < v->second.size (); i++)
+			if (LdapCache::in_subtree (records[v->second[i]].dn, nbase))
+			    candidates.push_back (v->second[i]);
+	    }
+	}
+	else {
+	    for (unsigned i = 0; i < records.size (); i++)
+		if (LdapCache::in_subtree (records[i].dn, nbase))
+		    candidates.push_back (i);
+	}
+    }
+
+    ret	= new LdapResults ();
+    for (unsigned i = 0; i < candidates.size (); i++) {
+	const LDAPEntry *entry	= full_entry (candidates[i]);
+	if (f.match (entry))
+	    ret->add (select_attributes (entry, attrs, attrsOnly));
+    }
+    return ret;
+}
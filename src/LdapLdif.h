@@ -0,0 +1,333 @@
+/* ------------------------------------------------------------------------------
+ * Copyright (c) 2026 SUSE LLC. All Rights Reserved.
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, contact SUSE LLC.
+ * ------------------------------------------------------------------------------
+ */
+/* LdapLdif.h
+ *
+ * Read-only LDAP data taken from LDIF file (offline backend)
+ *
+ * $Id$
+ */
+
+#ifndef _LdapLdif_h
+#define _LdapLdif_h
+
+#include <Y2.h>
+
+#include <LDAPConnection.h>
+#include <LDAPMessageQueue.h>
+#include <LDAPEntry.h>
+#include <LDAPAttributeList.h>
+
+#include <deque>
+#include <map>
+#include <vector>
+
+#include <stdio.h>
+
+/**
+ * (attribute, value) pairs of LDIF record in the order of the file
+ */
+typedef std::vector<std::pair<string, string> > LdifValues;
+
+/**
+ * @short Sequential reader of LDIF records, one record in memory at a time
+ */
+class LdifReader
+{
+public:
+    LdifReader ();
+    ~LdifReader ();
+
+    /**
+     * open the file
+     * @return false on error, see error ()
+     */
+    bool open (const string &file);
+
+    /**
+     * read next record; DN is empty when the record does not start
+     * with it
+     * @return false at the end of the file
+     */
+    bool next (string &dn, LdifValues &values);
+
+    /**
+     * line number where the last record started
+     */
+    int line () const { return record_line; }
+
+    /**
+     * description of last error
+     */
+    const string &error () const { return last_error; }
+
+    /**
+     * description of the value of last record that could not be decoded
+     * (wrong base64 or unreadable URL), empty if all values are fine;
+     * such record must not be used, its values are incomplete
+     */
+    const string &value_error () const { return bad_value; }
+
+    /**
+     * parse unfolded lines of one record: DN and list of (attribute, value)
+     * pairs; "changetype", "control" and "-" lines of change records
+     * are in the list too; value that cannot be decoded is left out and
+     * described in bad_value
+     * @return false if the record does not start with DN (then the
+     * first line is in values)
+     */
+    static bool parse (const std::vector<string> &lines, string &dn,
+	LdifValues &values, string &bad_value);
+
+    /**
+     * add the values to the list of attributes, values of one attribute
+     * need not be together
+     */
+    static void add_attributes (LDAPAttributeList &attrs,
+	const LdifValues &values, unsigned from = 0);
+
+private:
+    FILE	*file;
+    char	*buffer;
+    size_t	buffer_size;
+    int		lineno;
+    int		record_line;
+    string	last_error;
+    string	bad_value;
+
+    static bool decode_base64 (const string &in, string &out);
+    static bool read_url (const string &url, string &out);
+
+    LdifReader (const LdifReader&);
+    LdifReader& operator= (const LdifReader&);
+};
+
+/**
+ * @short Result of search: entries from server or from LDIF file
+ *
+ * getNext () returns new entry (to be deleted by the caller) or NULL
+ * at the end; for server results, it may throw LDAPException (for
+ * asynchronous search, also when the search failed as a whole).
+ */
+class LdapResults
+{
+public:
+    /**
+     * take the results of server search (may be NULL)
+     */
+    LdapResults (LDAPSearchResults *results = NULL);
+
+    /**
+     * take the messages of asynchronous server search
+     */
+    LdapResults (LDAPMessageQueue *queue);
+    ~LdapResults ();
+
+    /**
+     * append entry to the results (the object takes the ownership)
+     */
+    void add (LDAPEntry *entry);
+
+    LDAPEntry *getNext ();
+
+private:
+    LDAPSearchResults *results;
+    LDAPMessageQueue *queue;
+    std::deque<LDAPEntry*> entries;
+
+    LdapResults (const LdapResults&);
+    LdapResults& operator= (const LdapResults&);
+};
+
+/**
+ * @short Writer of LDIF file; values are written as they are, or base64
+ * encoded when they are not safe strings
+ */
+class LdifWriter
+{
+public:
+    LdifWriter ();
+    ~LdifWriter ();
+
+    /**
+     * create the file
+     * @return false on error, see error ()
+     */
+    bool open (const string &file);
+
+    /**
+     * start new entry
+     */
+    void entry (const char *dn, size_t length);
+
+    /**
+     * write one value of attribute of current entry
+     */
+    void value (const char *attr, size_t attr_length, const char *value,
+	size_t length);
+
+    /**
+     * finish the file
+     * @return false on write error, see error ()
+     */
+    bool close ();
+
+    /**
+     * number of written entries and bytes
+     */
+    int entries () const { return count; }
+    long long bytes () const { return written; }
+
+    /**
+     * description of last error
+     */
+    const string &error () const { return last_error; }
+
+private:
+    FILE	*file;
+    int		count;
+    long long	written;
+    string	last_error;
+    // buffer for the line being written
+    string	line;
+
+    void write_line (const char *attr, size_t attr_length, const char *value,
+	size_t length);
+
+    static bool is_safe (const char *value, size_t length);
+
+    LdifWriter (const LdifWriter&);
+    LdifWriter& operator= (const LdifWriter&);
+};
+
+/**
+ * @short LDAP entries of memory-mapped LDIF file(s)
+ *
+ * Entries are indexed by DN and by parent DN; values of selected
+ * attributes are indexed for equality filters. The data are only read,
+ * change records of LDIF are ignored.
+ */
+class LdifStore
+{
+public:
+    LdifStore ();
+    ~LdifStore ();
+
+    /**
+     * add the attribute to the equality index (before load)
+     */
+    void index (const string &attr);
+
+    /**
+     * map the file and index its entries; may be called for more files
+     * (e.g. data and schema)
+     * @return false on error, see error ()
+     */
+    bool load (const string &file);
+
+    /**
+     * search with the semantics of LDAPConnection::search:
+     * throws LDAPException when the base does not exist or the filter
+     * is wrong
+     * @return results to be deleted by the caller
+     */
+    LdapResults *search (const string &base, int scope, const string &filter,
+	const StringList &attrs, bool attrsOnly) const;
+
+    /**
+     * number of entries
+     */
+    int size () const { return records.size (); }
+
+    /**
+     * description of last error
+     */
+    const string &error () const { return last_error; }
+
+private:
+    struct Record
+    {
+	const char	*start;
+	size_t		length;
+	// normalized DN
+	string		dn;
+    };
+
+    // mapped files: address and length
+    std::vector<std::pair<void*, size_t> > maps;
+
+    std::vector<Record> records;
+
+    // parsed entries of the records, created on first search
+    mutable std::vector<LDAPEntry*> entries;
+
+    // normalized DN -> index of record
+    std::map<string, unsigned> by_dn;
+
+    // normalized DN -> indexes of child records
+    std::map<string, std::vector<unsigned> > children;
+
+    // lower-case attribute names to be indexed
+    std::vector<string> indexed;
+
+    // attribute -> lower-case value -> indexes of records (document order)
+    std::map<string, std::map<string, std::vector<unsigned> > > values;
+
+    string last_error;
+
+    /**
+     * parse the record: DN and list of (attribute, value) pairs
+     * @return false for record without DN or change record
+     */
+    static bool parse_record (const char *start, size_t length,
+	string &dn, LdifValues &attrs);
+
+    static bool is_operational (const string &attr);
+
+    /**
+     * entry of the record with all attributes and computed
+     * hasSubordinates and numSubordinates (parsed once and kept)
+     */
+    const LDAPEntry *full_entry (unsigned index) const;
+
+    /**
+     * create the root DSE: naming contexts are the entries without parent
+     */
+    LDAPEntry *root_dse () const;
+
+    /**
+     * indexes of the records whose parent is not in the store
+     */
+    std::vector<unsigned> suffixes () const;
+
+    /**
+     * forget parsed entries (subordinates may change with next file)
+     */
+    void clear_entries ();
+
+    /**
+     * create entry with requested attributes only
+     */
+    static LDAPEntry *select_attributes (const LDAPEntry *entry,
+	const StringList &attrs, bool attrsOnly);
+
+    void add_record (const char *start, size_t length);
+
+    LdifStore (const LdifStore&);
+    LdifStore& operator= (const LdifStore&);
+};
+
+#endif /* _LdapLdif_h */
@@ -0,0 +1,254 @@
+/* ------------------------------------------------------------------------------
+ * Copyright (c) 2026 SUSE LLC. All Rights Reserved.
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, contact SUSE LLC.
+ * ------------------------------------------------------------------------------
+ */
+/* LdapMicroBench.cc
+ *
+ * Microbenchmarks of Ldap agent conversions between LDAP and YCP data:
+ * time and number of allocations (operator new) per converted entry
+ *
+ * $Id$
+ */
+
+#include "LdapAgent.h"
+
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static long allocations	= 0;
+
+void* operator new (size_t size)
+{
+    allocations++;
+    void *p = malloc (size ? size : 1);
+    if (!p)
+	throw std::bad_alloc ();
+    return p;
+}
+
+void operator delete (void *p) noexcept
+{
+    free (p);
+}
+
+// minimal time of one benchmark in milliseconds
+static double min_time	= 200;
+
+/**
+ * access to private conversion methods of the agent
+ */
+class LdapMicroBench
+{
+public:
+    LdapMicroBench () : entry_wide ("cn=wide,dc=bench"),
+	entry_user ("uid=user,ou=people,dc=bench"),
+	entry_group ("cn=group,ou=groups,dc=bench"),
+	entry_cert ("uid=cert,ou=people,dc=bench") {}
+
+    void setup (int members);
+    void run ();
+
+private:
+    LdapAgent	agent;
+    LDAPEntry	entry_wide;
+    LDAPEntry	entry_user;
+    LDAPEntry	entry_group;
+    LDAPEntry	entry_cert;
+    StringList	member_list;
+    YCPMap	map_wide;
+    YCPMap	map_group;
+    YCPMap	map_cert;
+
+    void measure (const char *name, int id);
+    void one (int id);
+};
+
+/**
+ * synthetic data: wide entry (60 single valued attributes), posix user,
+ * group with many members and user with binary certificates
+ */
+void LdapMicroBench::setup (int members)
+{
+    char name[32], value[64];
+
+    LDAPAttributeList wide;
+    wide.addAttribute (LDAPAttribute ("objectClass", "extensibleObject"));
+    for (int i = 0; i < 60; i++) {
+	snprintf (name, sizeof (name), "attribute%d", i);
+	snprintf (value, sizeof (value), "value of attribute number %d", i);
+	wide.addAttribute (LDAPAttribute (name, value));
+	map_wide->add (YCPString (name), YCPString (value));
+    }
+    entry_wide.setAttributes (new LDAPAttributeList (wide));
+
+    LDAPAttributeList user;
+    StringList oc;
+    oc.add ("inetOrgPerson");
+    oc.add ("posixAccount");
+    oc.add ("shadowAccount");
+    user.addAttribute (LDAPAttribute ("objectClass", oc));
+    user.addAttribute (LDAPAttribute ("uid", "user"));
+    user.addAttribute (LDAPAttribute ("cn", "Bench User"));
+    user.addAttribute (LDAPAttribute ("sn", "User"));
+    user.addAttribute (LDAPAttribute ("uidNumber", "10000"));
+    user.addAttribute (LDAPAttribute ("gidNumber", "100"));
+    user.addAttribute (LDAPAttribute ("homeDirectory", "/home/user"));
+    user.addAttribute (LDAPAttribute ("loginShell", "/bin/bash"));
+    user.addAttribute (LDAPAttribute ("shadowLastChange", "19000"));
+    entry_user.setAttributes (new LDAPAttributeList (user));
+
+    LDAPAttributeList group;
+    YCPList ycp_members;
+    for (int i = 0; i < members; i++) {
+	snprintf (value, sizeof (value), "uid=user%d,ou=people,dc=bench", i);
+	member_list.add (value);
+	ycp_members->add (YCPString (value));
+    }
+    group.addAttribute (LDAPAttribute ("objectClass", "posixGroup"));
+    group.addAttribute (LDAPAttribute ("cn", "group"));
+    group.addAttribute (LDAPAttribute ("gidNumber", "100"));
+    group.addAttribute (LDAPAttribute ("uniqueMember", member_list));
+    entry_group.setAttributes (new LDAPAttributeList (group));
+    map_group->add (YCPString ("cn"), YCPString ("group"));
+    map_group->add (YCPString ("gidNumber"), YCPInteger (100));
+    map_group->add (YCPString ("uniqueMember"), ycp_members);
+
+    LDAPAttributeList cert (user);
+    LDAPAttribute certs ("userCertificate;binary");
+    YCPList ycp_certs;
+    unsigned char data[2048];
+    for (unsigned i = 0; i < sizeof (data); i++)
+	data[i] = i * 7;
+    for (int i = 0; i < 3; i++) {
+	BerValue val;
+	val.bv_len	= sizeof (data);
+	val.bv_val	= (char *) data;
+	certs.addValue (&val);
+	ycp_certs->add (YCPByteblock (data, sizeof (data)));
+    }
+    cert.addAttribute (certs);
+    entry_cert.setAttributes (new LDAPAttributeList (cert));
+    map_cert->add (YCPString ("uid"), YCPString ("cert"));
+    map_cert->add (YCPString ("userCertificate;binary"), ycp_certs);
+}
+
+/**
+ * one conversion of the benchmark with given id
+ */
+void LdapMicroBench::one (int id)
+{
+    switch (id) {
+	case 0: agent.getSearchedEntry (&entry_wide, false); break;
+	case 1: agent.getSearchedEntry (&entry_wide, true); break;
+	case 2: agent.getSearchedEntry (&entry_group, false); break;
+	case 3: agent.getSearchedEntry (&entry_cert, false); break;
+	case 4: agent.getUserEntry (&entry_user); break;
+	case 5: agent.getUserEntry (&entry_cert); break;
+	case 6: agent.getGroupEntry (&entry_group, "uniqueMember"); break;
+	case 7: agent.stringlist2ycplist (member_list); break;
+	case 8: {
+	    LDAPAttributeList attrs;
+	    agent.generate_attr_list (&attrs, map_wide);
+	    break;
+	}
+	case 9: {
+	    LDAPAttributeList attrs;
+	    agent.generate_attr_list (&attrs, map_group);
+	    break;
+	}
+	case 10: {
+	    LDAPAttributeList attrs;
+	    agent.generate_attr_list (&attrs, map_cert);
+	    break;
+	}
+	case 11: {
+	    LDAPModList mods;
+	    agent.generate_mod_list (&mods, map_wide, YCPVoid ());
+	    break;
+	}
+	case 12: {
+	    LDAPModList mods;
+	    agent.generate_mod_list (&mods, map_group, YCPVoid ());
+	    break;
+	}
+    }
+}
+
+/**
+ * repeat the conversion at least min_time ms and print time and
+ * allocations per one
+ */
+void LdapMicroBench::measure (const char *name, int id)
+{
+    // warm up
+    one (id);
+
+    long count	= 0;
+    long allocs	= allocations;
+    double start = LdapStats::now ();
+    double elapsed;
+    do {
+	for (int i = 0; i < 10; i++)
+	    one (id);
+	count	+= 10;
+	elapsed	= LdapStats::now () - start;
+    } while (elapsed < min_time);
+    allocs	= allocations - allocs;
+
+    printf ("%-40s %10ld %14.1f %12.1f\n", name, count,
+	elapsed * 1000000 / count, (double) allocs / count);
+}
+
+void LdapMicroBench::run ()
+{
+    printf ("%-40s %10s %14s %12s\n", "benchmark", "iterations", "ns/entry",
+	"allocs/entry");
+    measure ("getSearchedEntry/wide", 0);
+    measure ("getSearchedEntry/wide_single_values", 1);
+    measure ("getSearchedEntry/group", 2);
+    measure ("getSearchedEntry/certificates", 3);
+    measure ("getUserEntry/user", 4);
+    measure ("getUserEntry/certificates", 5);
+    measure ("getGroupEntry/group", 6);
+    measure ("stringlist2ycplist/members", 7);
+    measure ("generate_attr_list/wide", 8);
+    measure ("generate_attr_list/group", 9);
+    measure ("generate_attr_list/certificates", 10);
+    measure ("generate_mod_list/wide", 11);
+    measure ("generate_mod_list/group", 12);
+}
+
+int main (int argc, char *argv[])
+{
+    int members	= 10000;
+    int c;
+    while ((c = getopt (argc, argv, "m:t:")) != -1) {
+	switch (c) {
+	    case 'm': members	= atoi (optarg); break;
+	    case 't': min_time	= atof (optarg); break;
+	    default:
+		fprintf (stderr, "Usage: %s [-m group_members] [-t min_time_ms]\n",
+		    argv[0]);
+		return 1;
+	}
+    }
+    LdapMicroBench bench;
+    bench.setup (members);
+    bench.run ();
+    return 0;
+}
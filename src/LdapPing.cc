@@ -0,0 +1,242 @@
+/* ------------------------------------------------------------------------------
+ * Copyright (c) 2026 SUSE LLC. All Rights Reserved.
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, contact SUSE LLC.
+ * ------------------------------------------------------------------------------
+ */
+
+/* LdapPing.cc
+ *
+ * Concurrent check of LDAP servers availability
+ *
+ * $Id$
+ */
+
+#include "LdapPing.h"
+
+#include <LDAPConnection.h>
+#include <LDAPException.h>
+#include <ldap.h>
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#define STARTTLS_OID	"1.3.6.1.4.1.1466.20037"
+#define DEFAULT_PORT	389
+#define DEFAULT_SSL_PORT 636
+
+/**
+ * parse "host", "host:port" or "[ipv6]:port" string
+ */
+bool ldap_parse_hostport (const string &hostport, int default_port,
+    string &host, int &port)
+{
+    string rest;
+    port	= default_port;
+    if (!hostport.empty () && hostport[0] == '[') {
+	string::size_type end = hostport.find (']');
+	if (end == string::npos)
+	    return false;
+	host	= hostport.substr (1, end - 1);
+	rest	= hostport.substr (end + 1);
+    }
+    else {
+	string::size_type colon = hostport.rfind (':');
+	host	= hostport.substr (0, colon);
+	if (colon != string::npos)
+	    rest = hostport.substr (colon);
+    }
+    if (rest.empty ())
+	return true;
+    if (rest[0] != ':' || rest.size () == 1)
+	return false;
+    char *end;
+    port	= strtol (rest.c_str () + 1, &end, 10);
+    return *end == '\0';
+}
+
+/**
+ * decode %XX sequences of URI part
+ */
+static string uri_decode (const string &part)
+{
+    string ret;
+    for (string::size_type i = 0; i < part.size (); i++) {
+	if (part[i] == '%' && i + 2 < part.size () &&
+	    isxdigit (part[i+1]) && isxdigit (part[i+2])) {
+	    ret += (char) strtol (part.substr (i + 1, 2).c_str (), NULL, 16);
+	    i	+= 2;
+	}
+	else
+	    ret	+= part[i];
+    }
+    return ret;
+}
+
+/**
+ * parse LDAP URI of type "scheme://host:port/..." or "host:port" string
+ * into the server structure
+ */
+bool ldap_parse_uri (const string &uri, LdapPingResult &server)
+{
+    string::size_type sep = uri.find ("://");
+    if (sep == string::npos) {
+	server.uri	= "";
+	return ldap_parse_hostport (uri, DEFAULT_PORT, server.host, server.port);
+    }
+    string scheme	= uri.substr (0, sep);
+    string hostport	= uri.substr (sep + 3);
+    hostport		= hostport.substr (0, hostport.find ('/'));
+    // ldapi://%2Fpath%2Fto%2Fsocket: host is the socket path (empty
+    // for the default socket of libldap), there is no port
+    if (scheme == "ldapi") {
+	server.uri	= uri;
+	server.host	= uri_decode (hostport);
+	server.port	= 0;
+	return true;
+    }
+    if (scheme != "ldap" && scheme != "ldaps")
+	return false;
+    server.uri		= uri;
+    return ldap_parse_hostport (hostport,
+	scheme == "ldaps" ? DEFAULT_SSL_PORT : DEFAULT_PORT,
+	server.host, server.port);
+}
+
+/**
+ * check if the server is connected through Unix domain socket
+ */
+bool ldap_is_local (const LdapPingResult &server)
+{
+    return server.uri.compare (0, 8, "ldapi://") == 0;
+}
+
+/**
+ * probe one server: connect and read rootDSE, limited by timeout
+ */
+void ldap_ping_one (LdapPingResult &server, int timeout)
+{
+    struct timespec start, stop;
+    clock_gettime (CLOCK_MONOTONIC, &start);
+
+    LDAPConnection *conn = NULL;
+    LDAPSearchResults *entries = NULL;
+    try {
+	if (server.uri != "")
+	    conn = new LDAPConnection (server.uri, 0);
+	else
+	    conn = new LDAPConnection (server.host, server.port);
+	if (timeout > 0) {
+	    struct timeval tv;
+	    tv.tv_sec	= timeout / 1000;
+	    tv.tv_usec	= (timeout % 1000) * 1000;
+	    ldap_set_option (conn->getSessionHandle (), LDAP_OPT_NETWORK_TIMEOUT, &tv);
+	    ldap_set_option (conn->getSessionHandle (), LDAP_OPT_TIMEOUT, &tv);
+	}
+	StringList attrs;
+	attrs.add ("supportedExtension");
+	entries = conn->search ("", 0, "objectClass=*", attrs);
+	clock_gettime (CLOCK_MONOTONIC, &stop);
+
+	server.reachable = true;
+	LDAPEntry *entry = entries ? entries->getNext () : NULL;
+	if (entry) {
+	    const LDAPAttribute *ext =
+		entry->getAttributes ()->getAttributeByName ("supportedExtension");
+	    if (ext) {
+		StringList sl = ext->getValues ();
+		for (StringList::const_iterator i = sl.begin (); i != sl.end (); i++) {
+		    if (*i == STARTTLS_OID)
+			server.tls = true;
+		}
+	    }
+	    delete entry;
+	}
+    }
+    catch (LDAPException e) {
+	clock_gettime (CLOCK_MONOTONIC, &stop);
+	server.error_code	= e.getResultCode ();
+	server.error		= e.getResultMsg ();
+    }
+    server.latency	= (stop.tv_sec - start.tv_sec) * 1000.0 +
+	(stop.tv_nsec - start.tv_nsec) / 1000000.0;
+    server.finished	= true;
+    delete entries;
+    delete conn;
+}
+
+/**
+ * shared between the waiting caller and detached probing threads
+ * (threads of dead servers may still run after the caller returned)
+ */
+struct PingState
+{
+    std::mutex			mutex;
+    std::condition_variable	cond;
+    std::vector<LdapPingResult>	servers;
+    unsigned			finished;
+    bool			reachable;
+
+    PingState () : finished (0), reachable (false) {}
+};
+
+/**
+ * probe all servers concurrently; each one is probed in its own thread
+ */
+int ldap_ping (std::vector<LdapPingResult> &servers, int timeout, bool first)
+{
+    std::shared_ptr<PingState> state (new PingState);
+    state->servers	= servers;
+
+    for (unsigned i = 0; i < servers.size (); i++) {
+	LdapPingResult server = servers[i];
+	std::thread ([state, server, i, timeout] () mutable {
+	    ldap_ping_one (server, timeout);
+	    std::lock_guard<std::mutex> lock (state->mutex);
+	    state->servers[i] = server;
+	    state->finished++;
+	    state->reachable = state->reachable || server.reachable;
+	    state->cond.notify_all ();
+	}).detach ();
+    }
+
+    std::unique_lock<std::mutex> lock (state->mutex);
+    std::chrono::steady_clock::time_point deadline =
+	std::chrono::steady_clock::now () + std::chrono::milliseconds (timeout);
+    state->cond.wait_until (lock, deadline, [&state, first] () {
+	return state->finished == state->servers.size () ||
+	    (first && state->reachable);
+    });
+
+    int fastest	= -1;
+    for (unsigned i = 0; i < servers.size (); i++) {
+	servers[i]	= state->servers[i];
+	if (!servers[i].finished) {
+	    servers[i].error	= "timeout";
+	}
+	else if (servers[i].reachable && (fastest == -1 ||
+		servers[i].latency / std::max (servers[i].weight, 1) <
+		servers[fastest].latency / std::max (servers[fastest].weight, 1))) {
+	    fastest	= i;
+	}
+    }
+    return fastest;
+}
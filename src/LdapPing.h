@@ -0,0 +1,97 @@
+/* ------------------------------------------------------------------------------
+ * Copyright (c) 2026 SUSE LLC. All Rights Reserved.
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, contact SUSE LLC.
+ * ------------------------------------------------------------------------------
+ */
+
+/* LdapPing.h
+ *
+ * Concurrent check of LDAP servers availability
+ *
+ * $Id$
+ */
+
+#ifndef _LdapPing_h
+#define _LdapPing_h
+
+#include <Y2.h>
+
+#include <vector>
+
+/**
+ * state of one probed server
+ */
+struct LdapPingResult
+{
+    // LDAP URI; when empty, host and port are used for connection
+    // (ldap://, ldaps:// or ldapi:// with socket path as host)
+    string	uri;
+    string	host;
+    int		port;
+    // preference of the server, latency is divided by it when choosing
+    // the best one
+    int		weight;
+    // probe finished before the deadline
+    bool	finished;
+    // rootDSE search was successful
+    bool	reachable;
+    // server announces StartTLS extended operation
+    bool	tls;
+    // time of connect + rootDSE search in milliseconds
+    double	latency;
+    int		error_code;
+    string	error;
+
+    LdapPingResult (const string &h = "", int p = 0) :
+	host (h), port (p), weight (1), finished (false), reachable (false),
+	tls (false), latency (0), error_code (0) {}
+};
+
+/**
+ * parse "host", "host:port" or "[ipv6]:port" string
+ * @return false if port is not a number
+ */
+bool ldap_parse_hostport (const string &hostport, int default_port,
+    string &host, int &port);
+
+/**
+ * parse LDAP URI of type "scheme://host:port/..." or "host:port" string
+ * into the server structure; for "ldapi://" URI, host is the path
+ * of the socket and port is 0
+ * @return false if URI is not valid
+ */
+bool ldap_parse_uri (const string &uri, LdapPingResult &server);
+
+/**
+ * check if the server is connected through Unix domain socket (ldapi://)
+ */
+bool ldap_is_local (const LdapPingResult &server);
+
+/**
+ * probe one server: connect and read rootDSE, limited by timeout
+ * @param timeout timeout in milliseconds (0 means no timeout)
+ */
+void ldap_ping_one (LdapPingResult &server, int timeout);
+
+/**
+ * probe all servers concurrently; each one is probed in its own thread
+ * @param servers servers to check, results are filled in
+ * @param timeout deadline for the whole check in milliseconds
+ * @param first when true, return as soon as some server is reachable
+ * @return index of the best reachable server (lowest latency divided
+ * by weight) or -1
+ */
+int ldap_ping (std::vector<LdapPingResult> &servers, int timeout, bool first);
+
+#endif /* _LdapPing_h */
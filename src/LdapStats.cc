@@ -0,0 +1,351 @@
+/* ------------------------------------------------------------------------------
+ * Copyright (c) 2026 SUSE LLC. All Rights Reserved.
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, contact SUSE LLC.
+ * ------------------------------------------------------------------------------
+ */
+/* LdapStats.cc
+ *
+ * Operation statistics and trace log of Ldap agent
+ *
+ * $Id$
+ */
+
+#include "LdapStats.h"
+
+#include <LDAPEntry.h>
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+LdapStats::LdapStats ()
+{
+    since	= time (NULL);
+    trace_file	= NULL;
+    last_id	= 0;
+    slow_threshold	= 0;
+    slow_size	= 0;
+    count_bytes	= false;
+}
+
+LdapStats::~LdapStats ()
+{
+    trace ("");
+}
+
+LdapStats::Span::Span (LdapStats &s, const string &name) :
+    stats (s), depth (s.stack.size ()), ok (true)
+{
+    stats.begin (name);
+}
+
+LdapStats::Span::~Span ()
+{
+    while (stats.stack.size () > depth + 1)
+	stats.end (ok);
+    if (stats.stack.size () == depth + 1)
+	stats.end (ok);
+}
+
+double LdapStats::now ()
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+double LdapStats::cpu_now ()
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+void LdapStats::begin (const string &name)
+{
+    Frame frame;
+    frame.name		= name;
+    frame.id		= ++last_id;
+    frame.start		= now ();
+    // operation started before the trace was switched on is not traced
+    frame.traced	= trace_file != NULL || slow_threshold > 0;
+    if (frame.traced) {
+	frame.cpu_start	= cpu_now ();
+	clock_gettime (CLOCK_REALTIME, &frame.wall_start);
+    }
+    frame.entries	= 0;
+    frame.bytes		= 0;
+    frame.convert	= 0;
+    frame.wait		= 0;
+    stack.push_back (frame);
+}
+
+void LdapStats::end (bool ok)
+{
+    if (stack.empty ())
+	return;
+
+    Frame &frame	= stack.back ();
+    Counter &c		= counters[frame.name];
+    double wall		= now () - frame.start;
+    c.add (wall);
+    if (trace_file && frame.traced)
+	write_trace (frame, wall, cpu_now () - frame.cpu_start, ok);
+    if (slow_threshold > 0 && wall >= slow_threshold && frame.traced)
+	add_slow_op (frame, wall, ok);
+    if (!ok)
+	c.errors++;
+    c.entries	+= frame.entries;
+    c.bytes	+= frame.bytes;
+    c.convert	+= frame.convert;
+    stack.pop_back ();
+}
+
+void LdapStats::note_value (const string &key, const YCPValue &value)
+{
+    if (stack.empty () || !stack.back ().traced)
+	return;
+    std::map<string, YCPValue> &notes	= stack.back ().notes;
+    notes.erase (key);
+    notes.insert (std::make_pair (key, value));
+}
+
+void LdapStats::note (const string &key, const string &value)
+{
+    if (!stack.empty () && stack.back ().traced)
+	note_value (key, YCPString (value));
+}
+
+void LdapStats::note (const string &key, long value)
+{
+    if (!stack.empty () && stack.back ().traced)
+	note_value (key, YCPInteger (value));
+}
+
+void LdapStats::waited (double ms)
+{
+    for (std::vector<Frame>::iterator f = stack.begin (); f != stack.end (); f++)
+	f->wait	+= ms;
+}
+
+void LdapStats::volume (bool on)
+{
+    count_bytes	= on;
+}
+
+void LdapStats::slow_log (int threshold, int size)
+{
+    slow_threshold	= threshold > 0 ? threshold : 0;
+    slow_size		= size > 0 ? size : 0;
+    while (slow.size () > slow_size)
+	slow.pop_front ();
+}
+
+/**
+ * the time is split to waiting for server, conversion to YCP and the rest
+ * (agent's own work)
+ */
+void LdapStats::add_slow_op (const Frame &frame, double wall, bool ok)
+{
+    if (slow_size == 0)
+	return;
+
+    YCPMap op;
+    op->add (YCPString ("name"), YCPString (frame.name));
+    op->add (YCPString ("time"), YCPInteger (frame.wall_start.tv_sec));
+    op->add (YCPString ("ok"), YCPBoolean (ok));
+    op->add (YCPString ("wall_ms"), YCPFloat (wall));
+    op->add (YCPString ("wait_ms"), YCPFloat (frame.wait));
+    op->add (YCPString ("convert_ms"), YCPFloat (frame.convert));
+    op->add (YCPString ("entries"), YCPInteger (frame.entries));
+    op->add (YCPString ("bytes"), YCPInteger (frame.bytes));
+    for (std::map<string, YCPValue>::const_iterator i = frame.notes.begin ();
+	 i != frame.notes.end (); i++) {
+	op->add (YCPString (i->first), i->second);
+    }
+    if (slow.size () >= slow_size)
+	slow.pop_front ();
+    slow.push_back (op);
+}
+
+YCPList LdapStats::slow_ops ()
+{
+    YCPList ret;
+    for (std::deque<YCPMap>::const_iterator i = slow.begin ();
+	 i != slow.end (); i++) {
+	ret->add (*i);
+    }
+    return ret;
+}
+
+void LdapStats::reset_slow_ops ()
+{
+    slow.clear ();
+}
+
+bool LdapStats::trace (const string &file)
+{
+    if (trace_file) {
+	fclose (trace_file);
+	trace_file	= NULL;
+    }
+    if (file == "")
+	return true;
+
+    trace_file	= fopen (file.c_str (), "a");
+    if (!trace_file) {
+	y2error ("cannot open trace file %s", file.c_str ());
+	return false;
+    }
+    // complete lines are readable even when agent is killed
+    setvbuf (trace_file, NULL, _IOLBF, 0);
+    return true;
+}
+
+/**
+ * one line per operation: its id and id of the operation which called
+ * it (0 for agent calls), start time (seconds since epoch), wall and
+ * CPU time, volume and the noted parameters
+ */
+void LdapStats::write_trace (const Frame &frame, double wall, double cpu, bool ok)
+{
+    long parent	= stack.size () > 1 ? stack[stack.size () - 2].id : 0;
+    string notes;
+    for (std::map<string, YCPValue>::const_iterator i = frame.notes.begin ();
+	 i != frame.notes.end (); i++) {
+	notes	+= "," + json_string (i->first) + ":" + (i->second->isString () ?
+	    json_string (i->second->asString ()->value ()) : i->second->toString ());
+    }
+    fprintf (trace_file, "{\"id\":%ld,\"parent\":%ld,\"name\":%s,"
+	"\"start\":%ld.%06ld,\"wall_ms\":%.3f,\"cpu_ms\":%.3f,\"ok\":%s,"
+	"\"entries\":%ld,\"bytes\":%ld,\"convert_ms\":%.3f,\"wait_ms\":%.3f%s}\n",
+	frame.id, parent, json_string (frame.name).c_str (),
+	(long) frame.wall_start.tv_sec, frame.wall_start.tv_nsec / 1000,
+	wall, cpu, ok ? "true" : "false", frame.entries, frame.bytes,
+	frame.convert, frame.wait, notes.c_str ());
+}
+
+string LdapStats::json_string (const string &s)
+{
+    string ret	= "\"";
+    for (string::const_iterator i = s.begin (); i != s.end (); i++) {
+	unsigned char c	= *i;
+	if (c == '"' || c == '\\') {
+	    ret	+= '\\';
+	    ret	+= c;
+	}
+	else if (c < 0x20) {
+	    char buf[8];
+	    snprintf (buf, sizeof (buf), "\\u%04x", c);
+	    ret	+= buf;
+	}
+	else
+	    ret	+= c;
+    }
+    return ret + "\"";
+}
+
+/**
+ * size of entry data: DN, attribute names and values
+ */
+void LdapStats::received (const LDAPEntry *entry, double convert_ms)
+{
+    if (stack.empty () || !entry)
+	return;
+
+    // ldapcpp gives the values only as a copy (getValues, getBerValues),
+    // which is not for free with large groups: it is only done when
+    // somebody looks at the numbers
+    long bytes	= 0;
+    if (count_bytes || trace_file != NULL || slow_threshold > 0) {
+	bytes	= entry->getDN ().size ();
+	const LDAPAttributeList *al	= entry->getAttributes ();
+	for (LDAPAttributeList::const_iterator i = al->begin (); i != al->end (); i++) {
+	    bytes	+= i->getName ().size ();
+	    StringList sl	= i->getValues ();
+	    for (StringList::const_iterator j = sl.begin (); j != sl.end (); j++)
+		bytes	+= j->size ();
+	}
+    }
+    for (std::vector<Frame>::iterator f = stack.begin (); f != stack.end (); f++) {
+	f->entries++;
+	f->bytes	+= bytes;
+	f->convert	+= convert_ms;
+    }
+}
+
+LdapStats::Counter::Counter () :
+    count (0), errors (0), total (0), max (0), entries (0), bytes (0),
+    convert (0)
+{
+    memset (histogram, 0, sizeof (histogram));
+}
+
+void LdapStats::Counter::add (double ms)
+{
+    count++;
+    total	+= ms;
+    if (ms > max)
+	max	= ms;
+    double us	= ms * 1000;
+    int b	= us <= 1 ? 0 : (int) ceil (log2 (us) * 4);
+    histogram[b < STATS_BUCKETS ? b : STATS_BUCKETS - 1]++;
+}
+
+/**
+ * upper bound of the bucket containing given percentile (in ms),
+ * so the value is at most 19 % higher than the real one
+ */
+double LdapStats::Counter::percentile (double p) const
+{
+    long rank	= (long) ceil (p * count);
+    long seen	= 0;
+    for (int b = 0; b < STATS_BUCKETS; b++) {
+	seen	+= histogram[b];
+	if (seen >= rank && seen > 0)
+	    return std::min (pow (2, b / 4.0) / 1000, max);
+    }
+    return max;
+}
+
+YCPMap LdapStats::get ()
+{
+    YCPMap ops;
+    for (std::map<string, Counter>::const_iterator i = counters.begin ();
+	 i != counters.end (); i++) {
+	const Counter &c	= i->second;
+	YCPMap op;
+	op->add (YCPString ("count"), YCPInteger (c.count));
+	op->add (YCPString ("errors"), YCPInteger (c.errors));
+	op->add (YCPString ("total_ms"), YCPFloat (c.total));
+	op->add (YCPString ("max_ms"), YCPFloat (c.max));
+	op->add (YCPString ("p50_ms"), YCPFloat (c.percentile (0.50)));
+	op->add (YCPString ("p95_ms"), YCPFloat (c.percentile (0.95)));
+	op->add (YCPString ("p99_ms"), YCPFloat (c.percentile (0.99)));
+	op->add (YCPString ("entries"), YCPInteger (c.entries));
+	op->add (YCPString ("bytes"), YCPInteger (c.bytes));
+	op->add (YCPString ("convert_ms"), YCPFloat (c.convert));
+	ops->add (YCPString (i->first), op);
+    }
+    YCPMap ret;
+    ret->add (YCPString ("since"), YCPInteger (since));
+    ret->add (YCPString ("operations"), ops);
+    return ret;
+}
+
+void LdapStats::reset ()
+{
+    counters.clear ();
+    since	= time (NULL);
+}
@@ -0,0 +1,231 @@
+/* ------------------------------------------------------------------------------
+ * Copyright (c) 2026 SUSE LLC. All Rights Reserved.
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, contact SUSE LLC.
+ * ------------------------------------------------------------------------------
+ */
+/* LdapStats.h
+ *
+ * Operation statistics and trace log of Ldap agent
+ *
+ * $Id$
+ */
+
+#ifndef _LdapStats_h
+#define _LdapStats_h
+
+#include <Y2.h>
+
+#include <deque>
+#include <map>
+#include <stdio.h>
+#include <vector>
+#include <time.h>
+
+class LDAPEntry;
+
+// number of latency histogram buckets, bucket i holds the latencies
+// up to 2^(i/4) microseconds (the last one also all longer ones)
+#define STATS_BUCKETS 128
+
+/**
+ * @short Counts, latency histograms and volume of agent operations
+ *
+ * Operations may be nested (e.g. deleteSubTree called by Write): each
+ * open operation gets the entries and conversion time of nested ones.
+ * When the trace file is set, each finished operation is written there
+ * as one JSON line. Operations slower than the threshold are kept in
+ * the slow log.
+ */
+class LdapStats
+{
+public:
+    LdapStats ();
+    ~LdapStats ();
+
+    /**
+     * measures one operation during its lifetime; operations started
+     * by begin () inside and not finished are finished with it
+     */
+    class Span
+    {
+    public:
+	Span (LdapStats &stats, const string &name);
+	~Span ();
+	/**
+	 * mark the operation as failed (or successful again, e.g. after retry)
+	 */
+	void failed (bool f = true) { ok = !f; }
+    private:
+	LdapStats	&stats;
+	unsigned	depth;
+	bool		ok;
+    };
+
+    /**
+     * measures the time of waiting for server during its lifetime
+     */
+    class Wait
+    {
+    public:
+	Wait (LdapStats &s) : stats (s), start (now ()) {}
+	~Wait () { stats.waited (now () - start); }
+    private:
+	LdapStats	&stats;
+	double		start;
+    };
+
+    /**
+     * start the operation with given name
+     */
+    void begin (const string &name);
+
+    /**
+     * finish the last started operation and record it
+     */
+    void end (bool ok = true);
+
+    /**
+     * count the entry received from server and the time of its
+     * conversion to YCP (milliseconds)
+     */
+    void received (const LDAPEntry *entry, double convert_ms);
+
+    /**
+     * add the time of waiting for server (milliseconds)
+     */
+    void waited (double ms);
+
+    /**
+     * add the parameter (e.g. search base) to the current operation;
+     * only kept when it is written to trace or slow log
+     */
+    void note (const string &key, const string &value);
+    void note (const string &key, long value);
+
+    /**
+     * start writing the trace to given file (appending), empty name
+     * stops it
+     * @return false if file cannot be opened
+     */
+    bool trace (const string &file);
+
+    /**
+     * count bytes of received entries also when there is no trace
+     * or slow log
+     */
+    void volume (bool on);
+
+    /**
+     * keep operations taking at least threshold milliseconds (0 = none),
+     * up to size latest ones
+     */
+    void slow_log (int threshold, int size);
+
+    /**
+     * @return list of slow operations, the oldest first
+     */
+    YCPList slow_ops ();
+
+    /**
+     * forget slow operations
+     */
+    void reset_slow_ops ();
+
+    /**
+     * @return map with the statistics of each operation
+     */
+    YCPMap get ();
+
+    /**
+     * forget all the numbers
+     */
+    void reset ();
+
+    /**
+     * monotonic time in milliseconds
+     */
+    static double now ();
+
+private:
+    struct Frame
+    {
+	string	name;
+	long	id;
+	// parameters are collected (for trace or slow log)
+	bool	traced;
+	double	start;
+	double	cpu_start;
+	struct timespec	wall_start;
+	long	entries;
+	long	bytes;
+	double	convert;
+	double	wait;
+	// parameters of the operation
+	std::map<string, YCPValue> notes;
+    };
+
+    struct Counter
+    {
+	long	count;
+	long	errors;
+	double	total;
+	double	max;
+	long	entries;
+	long	bytes;
+	double	convert;
+	long	histogram[STATS_BUCKETS];
+
+	Counter ();
+	void add (double ms);
+	double percentile (double p) const;
+    };
+
+    std::vector<Frame>		stack;
+    std::map<string, Counter>	counters;
+    // time of the last reset
+    time_t			since;
+    FILE			*trace_file;
+    long			last_id;
+    int				slow_threshold;
+    bool			count_bytes;
+    unsigned			slow_size;
+    std::deque<YCPMap>		slow;
+
+    /**
+     * CPU time of the thread in milliseconds
+     */
+    static double cpu_now ();
+
+    /**
+     * write the finished operation to trace file
+     */
+    void write_trace (const Frame &frame, double wall, double cpu, bool ok);
+
+    /**
+     * add the finished operation to the slow log
+     */
+    void add_slow_op (const Frame &frame, double wall, bool ok);
+
+    /**
+     * set the parameter of current operation
+     */
+    void note_value (const string &key, const YCPValue &value);
+
+    /**
+     * quote string for JSON
+     */
+    static string json_string (const string &s);
+};
+
+#endif /* _LdapStats_h */
@@ -0,0 +1,146 @@
+/* ------------------------------------------------------------------------------
+ * Copyright (c) 2026 SUSE LLC. All Rights Reserved.
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, contact SUSE LLC.
+ * ------------------------------------------------------------------------------
+ */
+/* LdapTlsCache.cc
+ *
+ * Cache of TLS sessions for Ldap agent
+ *
+ * $Id$
+ */
+
+#include "LdapTlsCache.h"
+
+#include <openssl/ssl.h>
+#include <string.h>
+
+LdapTlsCache::LdapTlsCache ()
+{
+    openssl	= -1;
+}
+
+LdapTlsCache::~LdapTlsCache ()
+{
+    clear ();
+}
+
+int LdapTlsCache::connect_cb (LDAP *ld, void *ssl, void *ctx, void *arg)
+{
+    Server *server	= (Server *) arg;
+    if (!server || !ssl)
+	return 0;
+
+    server->handshakes++;
+    server->pending	= true;
+    if (server->session) {
+	SSL_set_session ((SSL *) ssl, (SSL_SESSION *) server->session);
+    }
+    return 0;
+}
+
+void LdapTlsCache::attach (LDAP *ld, const string &key)
+{
+    if (openssl == -1) {
+	char *package	= NULL;
+	ldap_get_option (NULL, LDAP_OPT_X_TLS_PACKAGE, &package);
+	openssl	= (package && strcmp (package, "OpenSSL") == 0) ? 1 : 0;
+	if (!openssl) {
+	    y2milestone ("TLS library is %s, sessions are not resumed",
+		package ? package : "unknown");
+	}
+	ldap_memfree (package);
+    }
+    if (!openssl || !ld)
+	return;
+
+    Server *server	= &servers[key];
+    ldap_set_option (ld, LDAP_OPT_X_TLS_CONNECT_CB, (void *) connect_cb);
+    ldap_set_option (ld, LDAP_OPT_X_TLS_CONNECT_ARG, (void *) server);
+}
+
+void LdapTlsCache::update (LDAP *ld)
+{
+    if (openssl != 1 || !ld)
+	return;
+
+    Server *server	= NULL;
+    SSL *ssl		= NULL;
+    ldap_get_option (ld, LDAP_OPT_X_TLS_CONNECT_ARG, &server);
+    ldap_get_option (ld, LDAP_OPT_X_TLS_SSL_CTX, &ssl);
+    if (!server || !ssl)
+	return;
+
+    if (server->pending) {
+	server->pending	= false;
+	if (SSL_session_reused (ssl))
+	    server->resumed++;
+    }
+    // with TLS 1.3, new ticket may come any time after the handshake
+    SSL_SESSION *session	= SSL_get1_session (ssl);
+    if (session) {
+	if (server->session)
+	    SSL_SESSION_free ((SSL_SESSION *) server->session);
+	server->session	= session;
+    }
+}
+
+/**
+ * sessions are freed, but the structures stay: existing connections
+ * still point to them
+ */
+void LdapTlsCache::clear ()
+{
+    for (std::map<string, Server>::iterator i = servers.begin ();
+	 i != servers.end (); i++) {
+	if (i->second.session)
+	    SSL_SESSION_free ((SSL_SESSION *) i->second.session);
+	i->second.session	= NULL;
+    }
+}
+
+YCPMap LdapTlsCache::stats ()
+{
+    // key contains certificate settings after the first line, report
+    // the numbers just by server
+    std::map<string, Server> by_name;
+    for (std::map<string, Server>::iterator i = servers.begin ();
+	 i != servers.end (); i++) {
+	Server &s	= by_name[i->first.substr (0, i->first.find ('\n'))];
+	s.handshakes	+= i->second.handshakes;
+	s.resumed	+= i->second.resumed;
+	if (i->second.session)
+	    s.session	= i->second.session;
+    }
+
+    YCPMap ret;
+    YCPMap by_server;
+    int handshakes	= 0;
+    int resumed		= 0;
+    for (std::map<string, Server>::iterator i = by_name.begin ();
+	 i != by_name.end (); i++) {
+	YCPMap s;
+	s->add (YCPString ("handshakes"), YCPInteger (i->second.handshakes));
+	s->add (YCPString ("resumed"), YCPInteger (i->second.resumed));
+	s->add (YCPString ("session"), YCPBoolean (i->second.session != NULL));
+	by_server->add (YCPString (i->first), s);
+	handshakes	+= i->second.handshakes;
+	resumed		+= i->second.resumed;
+    }
+    ret->add (YCPString ("handshakes"), YCPInteger (handshakes));
+    ret->add (YCPString ("resumed"), YCPInteger (resumed));
+    ret->add (YCPString ("servers"), by_server);
+    ret->add (YCPString ("enabled"), YCPBoolean (openssl != 0));
+    return ret;
+}
@@ -0,0 +1,93 @@
+/* ------------------------------------------------------------------------------
+ * Copyright (c) 2026 SUSE LLC. All Rights Reserved.
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, contact SUSE LLC.
+ * ------------------------------------------------------------------------------
+ */
+/* LdapTlsCache.h
+ *
+ * Cache of TLS sessions for Ldap agent
+ *
+ * $Id$
+ */
+
+#ifndef _LdapTlsCache_h
+#define _LdapTlsCache_h
+
+#include <Y2.h>
+
+#include <map>
+#include <ldap.h>
+
+/**
+ * @short TLS sessions of LDAP servers, so new connection to the same
+ * server can resume the session instead of full handshake
+ *
+ * Works only when libldap uses OpenSSL; with other TLS library
+ * connections do the full handshake as before.
+ */
+class LdapTlsCache
+{
+public:
+    LdapTlsCache ();
+    ~LdapTlsCache ();
+
+    /**
+     * register new connection handle: during its TLS handshake, stored
+     * session of the server with given key is offered for resumption
+     * @param key server and certificate settings of the connection
+     */
+    void attach (LDAP *ld, const string &key);
+
+    /**
+     * remember the TLS session of connection (if there is one) and note
+     * whether its handshake was resumed
+     */
+    void update (LDAP *ld);
+
+    /**
+     * forget all sessions
+     */
+    void clear ();
+
+    /**
+     * @return map with numbers of handshakes and resumed handshakes,
+     * in total and for each server
+     */
+    YCPMap stats ();
+
+private:
+    struct Server
+    {
+	void	*session;
+	// handshake started, but it was not checked by update yet
+	bool	pending;
+	int	handshakes;
+	int	resumed;
+
+	Server () : session (NULL), pending (false), handshakes (0),
+	    resumed (0) {}
+    };
+
+    std::map<string, Server> servers;
+
+    // -1 = not checked yet, 0 = other TLS library than OpenSSL, 1 = OpenSSL
+    int openssl;
+
+    /**
+     * called by libldap before TLS handshake, arg is the Server structure
+     */
+    static int connect_cb (LDAP *ld, void *ssl, void *ctx, void *arg);
+};
+
+#endif /* _LdapTlsCache_h */
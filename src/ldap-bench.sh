@@ -0,0 +1,135 @@
+#!/bin/sh
+#
+# ldap-bench.sh
+#
+# Starts throwaway slapd (mdb database in temporary directory) filled with
+# synthetic users and groups and runs ldap-bench against it, for each
+# directory size.
+#
+# Usage: ldap-bench.sh [-s "10000 100000 1000000"] [-g group_size]
+#	[-G groups] [-l] [-- ldap-bench options]
+#
+#   -s	numbers of users (one directory for each)
+#   -g	number of members of each group (default 100)
+#   -G	number of groups (default users / 100)
+#   -l	connect through ldapi:// socket instead of TCP
+#
+# Environment: SLAPD, SLAPADD, SCHEMA_DIR, MODULE_DIR, PORT, BENCH
+#
+# $Id$
+#
+
+SIZES="10000 100000 1000000"
+GROUP_SIZE=100
+NGROUPS=
+LDAPI=
+
+SLAPD=${SLAPD:-/usr/sbin/slapd}
+SLAPADD=${SLAPADD:-/usr/sbin/slapadd}
+SCHEMA_DIR=${SCHEMA_DIR:-/etc/openldap/schema}
+MODULE_DIR=${MODULE_DIR:-/usr/lib64/openldap}
+PORT=${PORT:-38999}
+BENCH=${BENCH:-./ldap-bench}
+
+while getopts "s:g:G:l" opt; do
+    case $opt in
+	s) SIZES=$OPTARG ;;
+	g) GROUP_SIZE=$OPTARG ;;
+	G) NGROUPS=$OPTARG ;;
+	l) LDAPI=1 ;;
+	*) sed -n '/^# Usage/,/^$/p' $0; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+BASE="dc=bench"
+
+# LDIF of the base, containers, users and groups (members are taken
+# round-robin from all users)
+generate ()
+{
+    awk -v users=$1 -v groups=$2 -v size=$GROUP_SIZE -v base=$BASE 'BEGIN {
+	printf "dn: %s\nobjectClass: dcObject\nobjectClass: organization\ndc: bench\no: bench\n\n", base
+	printf "dn: ou=people,%s\nobjectClass: organizationalUnit\nou: people\n\n", base
+	printf "dn: ou=groups,%s\nobjectClass: organizationalUnit\nou: groups\n\n", base
+	for (i = 0; i < users; i++) {
+	    printf "dn: uid=user%d,ou=people,%s\n", i, base
+	    printf "objectClass: inetOrgPerson\nobjectClass: posixAccount\n"
+	    printf "uid: user%d\ncn: User %d\nsn: %d\n", i, i, i
+	    printf "uidNumber: %d\ngidNumber: %d\n", 10000 + i, 100000 + i % groups
+	    printf "homeDirectory: /home/user%d\nloginShell: /bin/sh\n", i
+	    printf "userPassword: secret\n\n"
+	}
+	member = 0
+	for (g = 0; g < groups; g++) {
+	    printf "dn: cn=group%d,ou=groups,%s\n", g, base
+	    printf "objectClass: posixGroup\nobjectClass: extensibleObject\n"
+	    printf "cn: group%d\ngidNumber: %d\n", g, 100000 + g
+	    for (m = 0; m < size && m < users; m++) {
+		printf "uniqueMember: uid=user%d,ou=people,%s\n", member, base
+		member = (member + 1) % users
+	    }
+	    printf "\n"
+	}
+    }'
+}
+
+run ()
+{
+    users=$1
+    shift
+    groups=${NGROUPS:-$((users / 100))}
+    [ "$groups" -gt 0 ] || groups=1
+    dir=$(mktemp -d /tmp/ldap-bench.XXXXXX)
+    mkdir $dir/db
+
+    {
+	for schema in core cosine inetorgperson nis; do
+	    echo "include $SCHEMA_DIR/$schema.schema"
+	done
+	echo "pidfile $dir/slapd.pid"
+	if [ -e $MODULE_DIR/back_mdb.la ]; then
+	    echo "modulepath $MODULE_DIR"
+	    echo "moduleload back_mdb.la"
+	fi
+	echo "sizelimit unlimited"
+	echo "database mdb"
+	echo "maxsize 17179869184"
+	echo "suffix \"$BASE\""
+	echo "rootdn \"cn=admin,$BASE\""
+	echo "rootpw secret"
+	echo "directory $dir/db"
+	echo "index objectClass eq"
+	echo "index uid,cn eq"
+	echo "index uidNumber,gidNumber eq"
+	echo "index uniqueMember eq"
+    } > $dir/slapd.conf
+
+    echo "generating $users users in $groups groups..." >&2
+    generate $users $groups | $SLAPADD -q -f $dir/slapd.conf || return 1
+
+    socket=$(echo $dir/ldapi | sed 's|/|%2F|g')
+    $SLAPD -f $dir/slapd.conf -h "ldap://127.0.0.1:$PORT/ ldapi://$socket" || return 1
+    # wait for the server
+    for i in $(seq 50); do
+	[ -S $dir/ldapi ] && break
+	sleep 0.1
+    done
+
+    if [ -n "$LDAPI" ]; then
+	uri="ldapi://$socket"
+    else
+	uri="ldap://127.0.0.1:$PORT"
+    fi
+    $BENCH -H "$uri" -b $BASE -D "cn=admin,$BASE" -w secret -n $users "$@"
+    ret=$?
+
+    kill $(cat $dir/slapd.pid)
+    sleep 1
+    rm -rf $dir
+    return $ret
+}
+
+for size in $SIZES; do
+    run $size "$@" || exit 1
+done